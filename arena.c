@@ -0,0 +1,176 @@
+// This file implements bump-pointer arenas.
+//
+// The compiler creates millions of small objects such as tokens and
+// AST nodes and never frees them individually; they all live until
+// the end of the phase that owns them. An arena hands out memory by
+// bumping a pointer within a large block, so an allocation costs
+// almost nothing and the whole arena can be released at once.
+//
+// Memory returned by arena_alloc() is zero-initialized because blocks
+// are obtained with calloc and never reused without being freed.
+
+#include "zcc.h"
+#include <sys/resource.h>
+
+// Size of a regular arena block
+#define BLOCK_SIZE (1 << 20)
+
+// All objects are aligned to this boundary.
+#define ARENA_ALIGN 16
+
+struct ArenaBlock {
+    ArenaBlock *next;
+    long size;
+};
+
+// Tokens and hidesets created by the tokenizer and the preprocessor
+Arena token_arena = {"token"};
+
+// AST nodes, variables, initializers and functions
+Arena ast_arena = {"ast"};
+
+// Types and struct members
+Arena type_arena = {"type"};
+
+static void new_block(Arena *arena, long size) {
+    ArenaBlock *blk = calloc(1, sizeof(ArenaBlock) + size);
+    if (!blk)
+        error("out of memory");
+    blk->next = arena->blocks;
+    blk->size = size;
+    arena->blocks = blk;
+    arena->ptr = (char *)(blk + 1);
+    arena->end = arena->ptr + size;
+    arena->reserved += size;
+}
+
+void *arena_alloc(Arena *arena, long size) {
+    size = (size + ARENA_ALIGN - 1) & ~(long)(ARENA_ALIGN - 1);
+
+    if (arena->end - arena->ptr < size) {
+        // A large object gets a block of its own so that it doesn't
+        // waste the rest of the current block.
+        if (size > BLOCK_SIZE / 4) {
+            char *ptr = arena->ptr;
+            char *end = arena->end;
+            new_block(arena, size);
+            char *buf = arena->ptr;
+            arena->ptr = ptr;
+            arena->end = end;
+            arena->used += size;
+            if (arena->peak < arena->reserved)
+                arena->peak = arena->reserved;
+            return buf;
+        }
+        new_block(arena, BLOCK_SIZE);
+    }
+
+    char *buf = arena->ptr;
+    arena->ptr += size;
+    arena->used += size;
+    if (arena->peak < arena->reserved)
+        arena->peak = arena->reserved;
+    return buf;
+}
+
+// Frees all objects allocated from a given arena at once.
+// The totals are kept so that they can still be reported.
+void arena_release(Arena *arena) {
+    ArenaBlock *blk = arena->blocks;
+    while (blk) {
+        ArenaBlock *next = blk->next;
+        free(blk);
+        blk = next;
+    }
+    arena->blocks = NULL;
+    arena->ptr = arena->end = NULL;
+    arena->reserved = 0;
+}
+
+//
+// -fmem-report
+//
+// Allocation sites report each object with mem_count(), and the
+// counts are kept per category and per phase of the compiler. At the
+// end of each phase we also record the peak RSS of the process.
+//
+
+bool opt_mem_report;
+
+typedef struct {
+    long objects;
+    long bytes;
+} MemStat;
+
+static MemStat mem_stats[NUM_PHASES][NUM_MEM_KINDS];
+static long phase_rss[NUM_PHASES];
+static Phase current_phase;
+
+static char *mem_kind_names[] = {
+    "tokens", "copied tokens", "hidesets", "macros", "nodes", "types",
+    "vars", "initializers",
+};
+
+static char *phase_names[] = {
+    "tokenize", "preprocess", "parse", "codegen",
+};
+
+void mem_count(MemKind kind, long size) {
+    MemStat *stat = &mem_stats[current_phase][kind];
+    stat->objects++;
+    stat->bytes += size;
+}
+
+// Returns the number of objects of a given kind allocated so far.
+long mem_objects(MemKind kind) {
+    long n = 0;
+    for (int i = 0; i < NUM_PHASES; i++)
+        n += mem_stats[i][kind].objects;
+    return n;
+}
+
+// Returns the peak resident set size in kilobytes.
+static long peak_rss(void) {
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru))
+        return 0;
+    return ru.ru_maxrss;
+}
+
+// Ends the current phase and starts a given one.
+void mem_set_phase(Phase phase) {
+    phase_rss[current_phase] = peak_rss();
+    current_phase = phase;
+}
+
+void print_mem_report(void) {
+    phase_rss[current_phase] = peak_rss();
+
+    fprintf(stderr, "%-16s %-12s %12s %14s\n", "category", "phase", "objects", "bytes");
+    for (int i = 0; i < NUM_MEM_KINDS; i++) {
+        MemStat total = {};
+        for (int j = 0; j <= current_phase; j++) {
+            MemStat *stat = &mem_stats[j][i];
+            total.objects += stat->objects;
+            total.bytes += stat->bytes;
+            if (stat->objects)
+                fprintf(stderr, "%-16s %-12s %12ld %14ld\n", mem_kind_names[i],
+                        phase_names[j], stat->objects, stat->bytes);
+        }
+        fprintf(stderr, "%-16s %-12s %12ld %14ld\n", mem_kind_names[i],
+                "total", total.objects, total.bytes);
+    }
+
+    fprintf(stderr, "\n%-29s %14s\n", "phase", "peak RSS (KB)");
+    for (int i = 0; i <= current_phase; i++)
+        fprintf(stderr, "%-29s %14ld\n", phase_names[i], phase_rss[i]);
+}
+
+void print_arena_stats(void) {
+    Arena *arenas[] = {&token_arena, &ast_arena, &type_arena};
+
+    fprintf(stderr, "%-8s %14s %14s\n", "arena", "allocated", "peak");
+    for (int i = 0; i < sizeof(arenas) / sizeof(*arenas); i++)
+        fprintf(stderr, "%-8s %14ld %14ld\n",
+                arenas[i]->name, arenas[i]->used, arenas[i]->peak);
+}
@@ -0,0 +1,1025 @@
+// This file implements an assembler for the x86-64 code that
+// codegen.c emits. It reads Intel-syntax assembly and writes an ELF64
+// relocatable object file, so that -c doesn't need to run an external
+// assembler for every translation unit.
+//
+// The input always comes from our own code generator, so this is not
+// a general-purpose assembler. It understands exactly the instructions,
+// operand forms and directives that codegen.c uses and reports anything
+// else as an error.
+//
+// References are recorded as relocations while instructions are
+// encoded. Once the whole file has been read, PC-relative references
+// to local labels in the same section are resolved in place; the rest
+// are written to the object file for the linker.
+//
+// .file and .loc directives are ignored, so objects created this way
+// don't have line number information.
+
+#include "zcc.h"
+#include <elf.h>
+
+typedef struct Reloc Reloc;
+struct Reloc {
+    Reloc *next;
+    long offset;
+    char *sym;
+    int type;
+    long addend;
+};
+
+typedef struct {
+    char *name;
+    int type;
+    int flags;
+    int shndx;
+    int align;
+    char *data;
+    long len;
+    long cap;
+    Reloc *relocs;
+} Section;
+
+typedef struct {
+    char *name;
+    Section *sec; // NULL if undefined
+    long offset;
+    bool is_global;
+    int index;    // index in .symtab
+} Symbol;
+
+static Section text = {".text", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, 1, 1};
+static Section data = {".data", SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, 2, 1};
+static Section bss = {".bss", SHT_NOBITS, SHF_ALLOC | SHF_WRITE, 3, 1};
+
+// Section we are currently assembling into
+static Section *cur;
+
+static HashMap symbols;
+static Symbol **syms;
+static int nsyms;
+
+static char *input_path;
+static int line_no;
+
+static void asm_error(char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(stderr, "%s:%d: ", input_path, line_no);
+    vfprintf(stderr, fmt, ap);
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+//
+// Section contents
+//
+
+static void buf_write(Section *sec, void *p, long len) {
+    if (sec->len + len > sec->cap) {
+        sec->cap = sec->cap ? sec->cap * 2 : 4096;
+        while (sec->len + len > sec->cap)
+            sec->cap *= 2;
+        sec->data = realloc(sec->data, sec->cap);
+    }
+    memcpy(sec->data + sec->len, p, len);
+    sec->len += len;
+}
+
+static void buf_align(Section *sec, int align) {
+    static char zero[16];
+    while (sec->len % align)
+        buf_write(sec, zero, 1);
+}
+
+static void out_byte(int val) {
+    char c = val;
+    buf_write(cur, &c, 1);
+}
+
+// Writes the low `size` bytes of a given value in little endian.
+static void out_int(long val, int size) {
+    for (int i = 0; i < size; i++)
+        out_byte(val >> (i * 8));
+}
+
+static void out_zero(long n) {
+    if (cur == &bss) {
+        cur->len += n;
+        return;
+    }
+    while (n-- > 0)
+        out_byte(0);
+}
+
+//
+// Symbols and relocations
+//
+
+static Symbol *get_symbol(char *name) {
+    Symbol *sym = hashmap_get(&symbols, name);
+    if (sym)
+        return sym;
+
+    sym = calloc(1, sizeof(Symbol));
+    sym->name = name;
+    hashmap_put(&symbols, name, sym);
+
+    if ((nsyms & (nsyms - 1)) == 0)
+        syms = realloc(syms, sizeof(Symbol *) * (nsyms ? nsyms * 2 : 1));
+    syms[nsyms++] = sym;
+    return sym;
+}
+
+static bool is_local_label(char *name) {
+    return !strncmp(name, ".L", 2);
+}
+
+static void define_label(char *name) {
+    Symbol *sym = get_symbol(name);
+    if (sym->sec)
+        asm_error("symbol already defined: %s", name);
+    sym->sec = cur;
+    sym->offset = cur->len;
+}
+
+// Adds a relocation for a field at the current position and reserves
+// `size` bytes for it.
+static void out_reloc(char *sym, int type, long addend, int size) {
+    get_symbol(sym);
+
+    Reloc *rel = calloc(1, sizeof(Reloc));
+    rel->offset = cur->len;
+    rel->sym = sym;
+    rel->type = type;
+    rel->addend = addend;
+    rel->next = cur->relocs;
+    cur->relocs = rel;
+    out_zero(size);
+}
+
+//
+// Operands
+//
+
+typedef enum {
+    OP_REG,
+    OP_XMM,
+    OP_MEM,
+    OP_IMM,
+    OP_LABEL,
+} OperandKind;
+
+typedef struct {
+    OperandKind kind;
+    int size;   // operand size in bytes, or 0 if unknown
+    int reg;    // register number, or base register of a memory operand
+    bool rex;   // spl, bpl, sil and dil need a REX prefix
+    long val;   // immediate or displacement
+    char *sym;  // symbol of an immediate, label or RIP-relative operand
+    int reloc;  // relocation type for `sym`
+} Operand;
+
+// Base register of RIP-relative memory operands
+#define RIP -1
+
+typedef struct {
+    int size;
+    int num;
+} Register;
+
+static HashMap registers;
+
+static void init_registers(void) {
+    static char *names[4][16] = {
+        {"al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+         "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"},
+        {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di",
+         "r8w", "r9w", "r10w", "r11w", "r12w", "r13w", "r14w", "r15w"},
+        {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+         "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"},
+        {"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+         "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"},
+    };
+    static Register regs[4][16];
+
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 16; j++) {
+            regs[i][j].size = 1 << i;
+            regs[i][j].num = j;
+            hashmap_put(&registers, names[i][j], &regs[i][j]);
+        }
+    }
+}
+
+// Parses a general-purpose or an XMM register name.
+static bool parse_reg(char *s, Operand *op) {
+    if (!strncmp(s, "xmm", 3) && isdigit(s[3])) {
+        op->kind = OP_XMM;
+        op->reg = atoi(s + 3);
+        return true;
+    }
+
+    Register *reg = hashmap_get(&registers, s);
+    if (!reg)
+        return false;
+    op->kind = OP_REG;
+    op->size = reg->size;
+    op->reg = reg->num;
+    op->rex = reg->size == 1 && 4 <= reg->num && reg->num < 8;
+    return true;
+}
+
+static Operand parse_operand(char *s) {
+    Operand op = {};
+
+    while (*s == ' ')
+        s++;
+
+    if (!strncmp(s, "byte ptr ", 9)) {
+        op.size = 1;
+        s += 9;
+    } else if (!strncmp(s, "word ptr ", 9)) {
+        op.size = 2;
+        s += 9;
+    } else if (!strncmp(s, "dword ptr ", 10)) {
+        op.size = 4;
+        s += 10;
+    } else if (!strncmp(s, "qword ptr ", 10)) {
+        op.size = 8;
+        s += 10;
+    }
+
+    // [reg], [reg+disp] or [reg-disp]
+    if (*s == '[') {
+        char *p = s + 1;
+        while (isalnum(*p))
+            p++;
+        char c = *p;
+        *p = '\0';
+        Operand base = {};
+        if (!parse_reg(s + 1, &base) || base.kind != OP_REG || base.size != 8)
+            asm_error("invalid base register: %s", s + 1);
+        *p = c;
+
+        op.kind = OP_MEM;
+        op.reg = base.reg;
+        if (c == '+' || c == '-')
+            op.val = strtol(p, &p, 10);
+        if (*p != ']')
+            asm_error("invalid memory operand");
+        return op;
+    }
+
+    // sym[rip] or sym@GOTPCREL[rip]
+    char *rip = strstr(s, "[rip]");
+    if (rip) {
+        *rip = '\0';
+        op.kind = OP_MEM;
+        op.reg = RIP;
+        op.sym = s;
+        op.reloc = R_X86_64_PC32;
+
+        char *at = strchr(s, '@');
+        if (at) {
+            if (strcmp(at, "@GOTPCREL"))
+                asm_error("unknown relocation: %s", at);
+            *at = '\0';
+            op.reloc = R_X86_64_GOTPCREL;
+        }
+        return op;
+    }
+
+    if (!strncmp(s, "offset ", 7)) {
+        op.kind = OP_IMM;
+        op.sym = s + 7;
+        op.reloc = R_X86_64_32S;
+        return op;
+    }
+
+    if (*s == '-') {
+        op.kind = OP_IMM;
+        op.val = strtol(s, NULL, 10);
+        return op;
+    }
+
+    if (isdigit(*s)) {
+        op.kind = OP_IMM;
+        op.val = strtoul(s, NULL, 10);
+        return op;
+    }
+
+    if (parse_reg(s, &op))
+        return op;
+
+    op.kind = OP_LABEL;
+    op.sym = s;
+    return op;
+}
+
+//
+// Instruction encoder
+//
+
+static bool is_int8(long val) {
+    return val == (signed char)val;
+}
+
+static bool is_int32(long val) {
+    return val == (int)val;
+}
+
+// Writes a one- or two-byte opcode.
+static void out_opcode(int op) {
+    if (op > 0xff)
+        out_byte(op >> 8);
+    out_byte(op);
+}
+
+// Writes a ModRM byte, an optional SIB byte and a displacement for
+// a register or memory operand. `imm_size` is the size of the
+// immediate that follows, which RIP-relative displacements must
+// account for.
+static void out_modrm(int reg, Operand *rm, int imm_size) {
+    reg &= 7;
+
+    if (rm->kind == OP_REG || rm->kind == OP_XMM) {
+        out_byte(0xc0 | reg << 3 | (rm->reg & 7));
+        return;
+    }
+
+    if (rm->kind != OP_MEM)
+        asm_error("invalid operand");
+
+    if (rm->reg == RIP) {
+        out_byte(reg << 3 | 5);
+        out_reloc(rm->sym, rm->reloc, rm->val - 4 - imm_size, 4);
+        return;
+    }
+
+    // rbp and r13 have no encoding without a displacement, and
+    // rsp and r12 need a SIB byte.
+    int base = rm->reg & 7;
+    int mod = (rm->val == 0 && base != 5) ? 0 : is_int8(rm->val) ? 1 : 2;
+
+    out_byte(mod << 6 | reg << 3 | base);
+    if (base == 4)
+        out_byte(0x24);
+    if (mod == 1)
+        out_int(rm->val, 1);
+    else if (mod == 2)
+        out_int(rm->val, 4);
+}
+
+// Flag in the `reg` argument of out_insn() that forces a REX prefix
+#define REG_REX 16
+
+// Returns a register operand as the `reg` argument of out_insn().
+static int reg_field(Operand *op) {
+    return op->reg | (op->rex ? REG_REX : 0);
+}
+
+// Writes an instruction of the form
+// [prefix] [REX] opcode ModRM [SIB] [disp], where `reg` is the value
+// of the ModRM.reg field, either a register or an opcode extension.
+static void out_insn(int prefix, bool w, int op, int reg,
+                     Operand *rm, int imm_size) {
+    if (prefix)
+        out_byte(prefix);
+
+    int rex = (w << 3) | ((reg & 8) >> 1);
+    if (!(rm->kind == OP_MEM && rm->reg == RIP))
+        rex |= (rm->reg & 8) >> 3;
+    if (rex || (reg & REG_REX) || rm->rex)
+        out_byte(0x40 | rex);
+
+    // Let the linker turn GOT loads into lea if the symbol turns out
+    // to be local.
+    if (rm->kind == OP_MEM && rm->reloc == R_X86_64_GOTPCREL && op == 0x8b)
+        rm->reloc = rex ? R_X86_64_REX_GOTPCRELX : R_X86_64_GOTPCRELX;
+
+    out_opcode(op);
+    out_modrm(reg, rm, imm_size);
+}
+
+// Returns the operand-size prefix for a given size.
+static int size_prefix(int size) {
+    return size == 2 ? 0x66 : 0;
+}
+
+static void out_imm(Operand *op, int size) {
+    if (op->sym)
+        out_reloc(op->sym, op->reloc, op->val, size);
+    else
+        out_int(op->val, size);
+}
+
+typedef enum {
+    K_NOARG,
+    K_ALU,
+    K_SHIFT,
+    K_UNARY,
+    K_SETCC,
+    K_JMP,
+    K_CALL,
+    K_PUSH,
+    K_MOV,
+    K_MOVABS,
+    K_MOVX,
+    K_LEA,
+    K_IMUL,
+    K_SSE,
+    K_MOVSF,
+    K_CVTSI2F,
+    K_CVTF2SI,
+} InsnKind;
+
+typedef struct {
+    char *name;
+    InsnKind kind;
+    int op;     // opcode, or opcode extension in ModRM.reg
+    int prefix; // mandatory prefix of SSE instructions
+} Insn;
+
+static Insn insns[] = {
+    {"ret", K_NOARG, 0xc3},
+    {"cdq", K_NOARG, 0x99},
+    {"cqo", K_NOARG, 0x4899},
+    {"add", K_ALU, 0},
+    {"or", K_ALU, 1},
+    {"and", K_ALU, 4},
+    {"sub", K_ALU, 5},
+    {"xor", K_ALU, 6},
+    {"cmp", K_ALU, 7},
+    {"shl", K_SHIFT, 4},
+    {"shr", K_SHIFT, 5},
+    {"sar", K_SHIFT, 7},
+    {"not", K_UNARY, 2},
+    {"div", K_UNARY, 6},
+    {"idiv", K_UNARY, 7},
+    {"setb", K_SETCC, 0x0f92},
+    {"sete", K_SETCC, 0x0f94},
+    {"setne", K_SETCC, 0x0f95},
+    {"setbe", K_SETCC, 0x0f96},
+    {"setl", K_SETCC, 0x0f9c},
+    {"setle", K_SETCC, 0x0f9e},
+    {"jmp", K_JMP, 0xe9},
+    {"je", K_JMP, 0x0f84},
+    {"jne", K_JMP, 0x0f85},
+    {"call", K_CALL, 0xe8},
+    {"push", K_PUSH, 0x50},
+    {"pop", K_PUSH, 0x58},
+    {"mov", K_MOV},
+    {"movabs", K_MOVABS},
+    {"movsx", K_MOVX, 0x0fbe},
+    {"movzx", K_MOVX, 0x0fb6},
+    {"lea", K_LEA, 0x8d},
+    {"imul", K_IMUL, 0x0faf},
+    {"addss", K_SSE, 0x0f58, 0xf3},
+    {"addsd", K_SSE, 0x0f58, 0xf2},
+    {"mulss", K_SSE, 0x0f59, 0xf3},
+    {"mulsd", K_SSE, 0x0f59, 0xf2},
+    {"subss", K_SSE, 0x0f5c, 0xf3},
+    {"subsd", K_SSE, 0x0f5c, 0xf2},
+    {"divss", K_SSE, 0x0f5e, 0xf3},
+    {"divsd", K_SSE, 0x0f5e, 0xf2},
+    {"ucomiss", K_SSE, 0x0f2e},
+    {"ucomisd", K_SSE, 0x0f2e, 0x66},
+    {"xorps", K_SSE, 0x0f57},
+    {"xorpd", K_SSE, 0x0f57, 0x66},
+    {"cvtss2sd", K_SSE, 0x0f5a, 0xf3},
+    {"cvtsd2ss", K_SSE, 0x0f5a, 0xf2},
+    {"movss", K_MOVSF, 0x0f10, 0xf3},
+    {"movsd", K_MOVSF, 0x0f10, 0xf2},
+    {"cvtsi2ss", K_CVTSI2F, 0x0f2a, 0xf3},
+    {"cvtsi2sd", K_CVTSI2F, 0x0f2a, 0xf2},
+    {"cvttss2si", K_CVTF2SI, 0x0f2c, 0xf3},
+    {"cvttsd2si", K_CVTF2SI, 0x0f2c, 0xf2},
+};
+
+static HashMap insn_map;
+
+static void expect_operands(int nops, int n) {
+    if (nops != n)
+        asm_error("expected %d operands, but got %d", n, nops);
+}
+
+// Returns the size of a register or memory operand. A memory operand
+// without "ptr" takes the size of the other operand.
+static int operand_size(Operand *op, Operand *other) {
+    if (op->size)
+        return op->size;
+    if (other && other->size)
+        return other->size;
+    asm_error("unknown operand size");
+    return 0;
+}
+
+static void assemble_mov(Operand *dst, Operand *src) {
+    if (src->kind == OP_IMM) {
+        int size = operand_size(dst, NULL);
+
+        if (dst->kind == OP_REG && size == 8 && !src->sym && !is_int32(src->val)) {
+            // movabs
+            out_byte(0x48 | (dst->reg & 8) >> 3);
+            out_byte(0xb8 | (dst->reg & 7));
+            out_int(src->val, 8);
+            return;
+        }
+
+        if (dst->kind == OP_REG && size == 4) {
+            if (dst->reg & 8)
+                out_byte(0x41);
+            out_byte(0xb8 | (dst->reg & 7));
+            out_imm(src, 4);
+            return;
+        }
+
+        if (size == 1) {
+            out_insn(0, false, 0xc6, 0, dst, 1);
+            out_imm(src, 1);
+            return;
+        }
+
+        int imm_size = size == 2 ? 2 : 4;
+        out_insn(size_prefix(size), size == 8, 0xc7, 0, dst, imm_size);
+        out_imm(src, imm_size);
+        return;
+    }
+
+    if (src->kind == OP_REG) {
+        int size = src->size;
+        out_insn(size_prefix(size), size == 8, size == 1 ? 0x88 : 0x89,
+                 reg_field(src), dst, 0);
+        return;
+    }
+
+    if (dst->kind == OP_REG && src->kind == OP_MEM) {
+        int size = dst->size;
+        out_insn(size_prefix(size), size == 8, size == 1 ? 0x8a : 0x8b,
+                 reg_field(dst), src, 0);
+        return;
+    }
+
+    asm_error("invalid operands for mov");
+}
+
+static void assemble_alu(int ext, Operand *dst, Operand *src) {
+    int size = operand_size(dst, src);
+
+    if (src->kind == OP_IMM) {
+        if (size == 1) {
+            out_insn(0, false, 0x80, ext, dst, 1);
+            out_imm(src, 1);
+        } else if (is_int8(src->val)) {
+            out_insn(size_prefix(size), size == 8, 0x83, ext, dst, 1);
+            out_imm(src, 1);
+        } else {
+            int imm_size = size == 2 ? 2 : 4;
+            out_insn(size_prefix(size), size == 8, 0x81, ext, dst, imm_size);
+            out_imm(src, imm_size);
+        }
+        return;
+    }
+
+    // add r/m, r is 01 /r, or r/m, r is 09 /r, and so on.
+    int op = ext << 3 | (size == 1 ? 0 : 1);
+
+    if (src->kind == OP_REG) {
+        out_insn(size_prefix(size), size == 8, op, reg_field(src), dst, 0);
+        return;
+    }
+    if (dst->kind == OP_REG && src->kind == OP_MEM) {
+        out_insn(size_prefix(size), size == 8, op | 2, reg_field(dst), src, 0);
+        return;
+    }
+    asm_error("invalid operands");
+}
+
+static void assemble_insn(char *name, Operand *ops, int nops) {
+    Insn *insn = hashmap_get(&insn_map, name);
+    if (!insn)
+        asm_error("unknown instruction: %s", name);
+
+    Operand *dst = &ops[0];
+    Operand *src = &ops[1];
+
+    switch (insn->kind) {
+    case K_NOARG:
+        expect_operands(nops, 0);
+        out_opcode(insn->op);
+        return;
+    case K_ALU:
+        expect_operands(nops, 2);
+        assemble_alu(insn->op, dst, src);
+        return;
+    case K_SHIFT: {
+        expect_operands(nops, 2);
+        int size = operand_size(dst, NULL);
+        if (src->kind == OP_IMM) {
+            out_insn(size_prefix(size), size == 8, size == 1 ? 0xc0 : 0xc1,
+                     insn->op, dst, 1);
+            out_imm(src, 1);
+            return;
+        }
+        if (src->kind != OP_REG || src->size != 1 || src->reg != 1)
+            asm_error("shift count must be an immediate or cl");
+        out_insn(size_prefix(size), size == 8, size == 1 ? 0xd2 : 0xd3,
+                 insn->op, dst, 0);
+        return;
+    }
+    case K_UNARY: {
+        expect_operands(nops, 1);
+        int size = operand_size(dst, NULL);
+        out_insn(size_prefix(size), size == 8, size == 1 ? 0xf6 : 0xf7,
+                 insn->op, dst, 0);
+        return;
+    }
+    case K_SETCC:
+        expect_operands(nops, 1);
+        out_insn(0, false, insn->op, 0, dst, 0);
+        return;
+    case K_JMP:
+        expect_operands(nops, 1);
+        if (dst->kind != OP_LABEL)
+            asm_error("jump target must be a label");
+        out_opcode(insn->op);
+        out_reloc(dst->sym, R_X86_64_PC32, -4, 4);
+        return;
+    case K_CALL:
+        expect_operands(nops, 1);
+        if (dst->kind == OP_LABEL) {
+            out_opcode(insn->op);
+            out_reloc(dst->sym, R_X86_64_PLT32, -4, 4);
+            return;
+        }
+        // call r/m64 is FF /2.
+        out_insn(0, false, 0xff, 2, dst, 0);
+        return;
+    case K_PUSH:
+        expect_operands(nops, 1);
+        if (dst->kind != OP_REG || dst->size != 8)
+            asm_error("invalid operand");
+        if (dst->reg & 8)
+            out_byte(0x41);
+        out_byte(insn->op | (dst->reg & 7));
+        return;
+    case K_MOV:
+        expect_operands(nops, 2);
+        assemble_mov(dst, src);
+        return;
+    case K_MOVABS:
+        expect_operands(nops, 2);
+        if (dst->kind != OP_REG || dst->size != 8 || src->kind != OP_IMM)
+            asm_error("invalid operands for movabs");
+        out_byte(0x48 | (dst->reg & 8) >> 3);
+        out_byte(0xb8 | (dst->reg & 7));
+        out_int(src->val, 8);
+        return;
+    case K_MOVX: {
+        expect_operands(nops, 2);
+        int size = operand_size(src, NULL);
+        if (size == 4 && insn->op == 0x0fbe) {
+            // movsxd
+            out_insn(0, true, 0x63, dst->reg, src, 0);
+            return;
+        }
+        if (size != 1 && size != 2)
+            asm_error("invalid operand size");
+        out_insn(size_prefix(dst->size), dst->size == 8, insn->op + (size == 2),
+                 dst->reg, src, 0);
+        return;
+    }
+    case K_LEA:
+        expect_operands(nops, 2);
+        out_insn(0, dst->size == 8, insn->op, dst->reg, src, 0);
+        return;
+    case K_IMUL:
+        expect_operands(nops, 2);
+        out_insn(size_prefix(dst->size), dst->size == 8, insn->op,
+                 dst->reg, src, 0);
+        return;
+    case K_SSE:
+        expect_operands(nops, 2);
+        out_insn(insn->prefix, false, insn->op, dst->reg, src, 0);
+        return;
+    case K_MOVSF:
+        expect_operands(nops, 2);
+        if (dst->kind == OP_XMM)
+            out_insn(insn->prefix, false, insn->op, dst->reg, src, 0);
+        else
+            out_insn(insn->prefix, false, insn->op + 1, src->reg, dst, 0);
+        return;
+    case K_CVTSI2F:
+        expect_operands(nops, 2);
+        out_insn(insn->prefix, operand_size(src, NULL) == 8, insn->op,
+                 dst->reg, src, 0);
+        return;
+    case K_CVTF2SI:
+        expect_operands(nops, 2);
+        out_insn(insn->prefix, dst->size == 8, insn->op, dst->reg, src, 0);
+        return;
+    }
+}
+
+//
+// Directives
+//
+
+static void assemble_directive(char *s) {
+    char *arg = strchr(s, ' ');
+    if (arg)
+        *arg++ = '\0';
+
+    if (!strcmp(s, ".text")) {
+        cur = &text;
+    } else if (!strcmp(s, ".data")) {
+        cur = &data;
+    } else if (!strcmp(s, ".bss")) {
+        cur = &bss;
+    } else if (!strcmp(s, ".byte")) {
+        out_byte(strtol(arg, NULL, 10));
+    } else if (!strcmp(s, ".zero")) {
+        out_zero(strtol(arg, NULL, 10));
+    } else if (!strcmp(s, ".quad")) {
+        // .quad sym+addend
+        char *p = arg + 1;
+        while (*p && *p != '+' && *p != '-')
+            p++;
+        long addend = strtol(p, NULL, 10);
+        *p = '\0';
+        out_reloc(arg, R_X86_64_64, addend, 8);
+    } else if (!strcmp(s, ".align")) {
+        int align = strtol(arg, NULL, 10);
+        if (align <= 0 || (align & (align - 1)))
+            asm_error("invalid alignment: %d", align);
+        if (cur->align < align)
+            cur->align = align;
+        out_zero((align - cur->len % align) % align);
+    } else if (!strcmp(s, ".globl")) {
+        get_symbol(arg)->is_global = true;
+    } else if (strcmp(s, ".intel_syntax") && strcmp(s, ".file") && strcmp(s, ".loc")) {
+        asm_error("unknown directive: %s", s);
+    }
+}
+
+static void assemble_line(char *s) {
+    while (*s == ' ' || *s == '\t')
+        s++;
+    if (!*s)
+        return;
+
+    int len = strlen(s);
+    if (s[len - 1] == ':') {
+        s[len - 1] = '\0';
+        define_label(s);
+        return;
+    }
+
+    if (*s == '.') {
+        assemble_directive(s);
+        return;
+    }
+
+    if (cur != &text)
+        asm_error("instruction outside of .text");
+
+    // Split the mnemonic and comma-separated operands.
+    char *p = strchr(s, ' ');
+    Operand ops[2];
+    int nops = 0;
+
+    if (p) {
+        *p++ = '\0';
+        while (*p) {
+            if (nops == 2)
+                asm_error("too many operands");
+            char *comma = strchr(p, ',');
+            if (comma)
+                *comma = '\0';
+            ops[nops++] = parse_operand(p);
+            if (!comma)
+                break;
+            p = comma + 1;
+        }
+    }
+    assemble_insn(s, ops, nops);
+}
+
+// Resolves PC-relative references to local symbols in the same
+// section and removes them from the relocation list.
+static void resolve_relocs(Section *sec) {
+    Reloc **p = &sec->relocs;
+    while (*p) {
+        Reloc *rel = *p;
+        Symbol *sym = get_symbol(rel->sym);
+
+        if (!sym->sec && is_local_label(sym->name))
+            error("%s: undefined label: %s", input_path, sym->name);
+
+        if (rel->type == R_X86_64_PC32 && sym->sec == sec && !sym->is_global) {
+            int val = sym->offset + rel->addend - rel->offset;
+            memcpy(sec->data + rel->offset, &val, 4);
+            *p = rel->next;
+            continue;
+        }
+        p = &rel->next;
+    }
+}
+
+//
+// ELF writer
+//
+
+static int add_string(Section *strtab, char *s) {
+    int off = strtab->len;
+    buf_write(strtab, s, strlen(s) + 1);
+    return off;
+}
+
+static void add_symbol(Section *symtab, int name, int bind, int type,
+                       int shndx, long value) {
+    Elf64_Sym esym = {};
+    esym.st_name = name;
+    esym.st_info = ELF64_ST_INFO(bind, type);
+    esym.st_shndx = shndx;
+    esym.st_value = value;
+    buf_write(symtab, &esym, sizeof(esym));
+}
+
+static void write_rela(Section *rela, Section *sec) {
+    for (Reloc *rel = sec->relocs; rel; rel = rel->next) {
+        Symbol *sym = get_symbol(rel->sym);
+        Elf64_Rela erel = {};
+        erel.r_offset = rel->offset;
+        erel.r_addend = rel->addend;
+
+        // References to local symbols go through the section symbol,
+        // except for GOT entries which must be keyed by the symbol.
+        if (sym->sec && !sym->is_global && rel->type != R_X86_64_GOTPCREL &&
+            rel->type != R_X86_64_GOTPCRELX && rel->type != R_X86_64_REX_GOTPCRELX) {
+            erel.r_info = ELF64_R_INFO(sym->sec->shndx, rel->type);
+            erel.r_addend += sym->offset;
+        } else {
+            erel.r_info = ELF64_R_INFO(sym->index, rel->type);
+        }
+        buf_write(rela, &erel, sizeof(erel));
+    }
+}
+
+static void write_elf(char *path) {
+    Section strtab = {".strtab", SHT_STRTAB, 0, 7, 1};
+    Section symtab = {".symtab", SHT_SYMTAB, 0, 6, 8};
+    Section rela_text = {".rela.text", SHT_RELA, SHF_INFO_LINK, 4, 8};
+    Section rela_data = {".rela.data", SHT_RELA, SHF_INFO_LINK, 5, 8};
+    Section shstrtab = {".shstrtab", SHT_STRTAB, 0, 8, 1};
+    Section note = {".note.GNU-stack", SHT_PROGBITS, 0, 9, 1};
+
+    // The symbol table lists the null symbol, section symbols, local
+    // symbols and global symbols in this order.
+    add_string(&strtab, "");
+    add_symbol(&symtab, 0, STB_LOCAL, STT_NOTYPE, SHN_UNDEF, 0);
+    add_symbol(&symtab, 0, STB_LOCAL, STT_SECTION, text.shndx, 0);
+    add_symbol(&symtab, 0, STB_LOCAL, STT_SECTION, data.shndx, 0);
+    add_symbol(&symtab, 0, STB_LOCAL, STT_SECTION, bss.shndx, 0);
+    int idx = 4;
+
+    for (int i = 0; i < nsyms; i++) {
+        Symbol *sym = syms[i];
+        if (sym->sec && !sym->is_global && !is_local_label(sym->name)) {
+            sym->index = idx++;
+            add_symbol(&symtab, add_string(&strtab, sym->name), STB_LOCAL,
+                       STT_NOTYPE, sym->sec->shndx, sym->offset);
+        }
+    }
+
+    int first_global = idx;
+    for (int i = 0; i < nsyms; i++) {
+        Symbol *sym = syms[i];
+        if (sym->is_global || !sym->sec) {
+            sym->index = idx++;
+            add_symbol(&symtab, add_string(&strtab, sym->name), STB_GLOBAL,
+                       STT_NOTYPE, sym->sec ? sym->sec->shndx : SHN_UNDEF,
+                       sym->offset);
+        }
+    }
+
+    write_rela(&rela_text, &text);
+    write_rela(&rela_data, &data);
+
+    Section *sections[] = {
+        &text, &data, &bss, &rela_text, &rela_data,
+        &symtab, &strtab, &shstrtab, &note,
+    };
+    int nsections = sizeof(sections) / sizeof(*sections);
+
+    add_string(&shstrtab, "");
+    int names[16];
+    for (int i = 0; i < nsections; i++)
+        names[i] = add_string(&shstrtab, sections[i]->name);
+
+    // Lay out the file: ELF header, section contents, section headers.
+    Section out = {};
+    Elf64_Ehdr ehdr = {};
+    buf_write(&out, &ehdr, sizeof(ehdr));
+
+    long offsets[16];
+    for (int i = 0; i < nsections; i++) {
+        buf_align(&out, sections[i]->align);
+        offsets[i] = out.len;
+        if (sections[i]->type != SHT_NOBITS)
+            buf_write(&out, sections[i]->data, sections[i]->len);
+    }
+
+    buf_align(&out, 8);
+    long shoff = out.len;
+
+    Elf64_Shdr null_shdr = {};
+    buf_write(&out, &null_shdr, sizeof(null_shdr));
+
+    for (int i = 0; i < nsections; i++) {
+        Section *sec = sections[i];
+        Elf64_Shdr shdr = {};
+        shdr.sh_name = names[i];
+        shdr.sh_type = sec->type;
+        shdr.sh_flags = sec->flags;
+        shdr.sh_offset = offsets[i];
+        shdr.sh_size = sec->len;
+        shdr.sh_addralign = sec->align;
+
+        if (sec->type == SHT_RELA) {
+            shdr.sh_link = symtab.shndx;
+            shdr.sh_info = sec == &rela_text ? text.shndx : data.shndx;
+            shdr.sh_entsize = sizeof(Elf64_Rela);
+        } else if (sec->type == SHT_SYMTAB) {
+            shdr.sh_link = strtab.shndx;
+            shdr.sh_info = first_global;
+            shdr.sh_entsize = sizeof(Elf64_Sym);
+        }
+        buf_write(&out, &shdr, sizeof(shdr));
+    }
+
+    Elf64_Ehdr *eh = (Elf64_Ehdr *)out.data;
+    memcpy(eh->e_ident, ELFMAG, SELFMAG);
+    eh->e_ident[EI_CLASS] = ELFCLASS64;
+    eh->e_ident[EI_DATA] = ELFDATA2LSB;
+    eh->e_ident[EI_VERSION] = EV_CURRENT;
+    eh->e_ident[EI_OSABI] = ELFOSABI_NONE;
+    eh->e_type = ET_REL;
+    eh->e_machine = EM_X86_64;
+    eh->e_version = EV_CURRENT;
+    eh->e_shoff = shoff;
+    eh->e_ehsize = sizeof(Elf64_Ehdr);
+    eh->e_shentsize = sizeof(Elf64_Shdr);
+    eh->e_shnum = nsections + 1;
+    eh->e_shstrndx = shstrtab.shndx;
+
+    FILE *fp = fopen(path, "w");
+    if (!fp)
+        error("cannot open output file %s: %s", path, strerror(errno));
+    if (fwrite(out.data, 1, out.len, fp) != out.len || fclose(fp))
+        error("%s: write failed: %s", path, strerror(errno));
+}
+
+static char *read_input(char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        error("cannot open %s: %s", path, strerror(errno));
+
+    struct stat st;
+    if (fstat(fileno(fp), &st))
+        error("%s: fstat failed: %s", path, strerror(errno));
+
+    char *buf = malloc(st.st_size + 1);
+    if (fread(buf, 1, st.st_size, fp) != st.st_size)
+        error("%s: read failed", path);
+    buf[st.st_size] = '\0';
+    fclose(fp);
+    return buf;
+}
+
+// Assembles a given assembly file into an object file.
+void assemble(char *input, char *output) {
+    input_path = input;
+    init_registers();
+    for (int i = 0; i < sizeof(insns) / sizeof(*insns); i++)
+        hashmap_put(&insn_map, insns[i].name, &insns[i]);
+
+    cur = &text;
+    char *p = read_input(input);
+
+    for (;;) {
+        char *end = strchr(p, '\n');
+        if (end)
+            *end = '\0';
+        line_no++;
+        assemble_line(p);
+        if (!end)
+            break;
+        p = end + 1;
+    }
+
+    resolve_relocs(&text);
+    resolve_relocs(&data);
+    write_elf(output);
+}
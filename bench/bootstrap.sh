@@ -0,0 +1,91 @@
+#!/bin/bash
+# Compares the speed of zcc built by gcc with zcc-stage2, which is zcc
+# built by itself. Both compilers compile the same corpus, so the ratio
+# of their run times measures the quality of the code that zcc
+# generates for a real program. The corpus consists of synthetic
+# sources written by bench/gen, tests/tests.c and the sources of zcc.
+#
+# The size of both binaries is reported as well, and so are instruction
+# and cycle counts if `perf` is available.
+#
+# Usage: bootstrap.sh <zcc> <zcc-stage2> <gen> <tmpdir> <results>
+set -e
+
+ZCC=$1
+STAGE2=$2
+GEN=$3
+TMP=$4
+RESULTS=$5
+
+SYSINC="-Iinclude -I/usr/local/include -I/usr/include -I/usr/include/linux -I/usr/include/x86_64-linux-gnu"
+
+mkdir -p $TMP/corpus
+
+$GEN globals 2000 > $TMP/corpus/globals.c
+$GEN initializers 2000 > $TMP/corpus/initializers.c
+$GEN functions 2000 > $TMP/corpus/functions.c
+$GEN elseif 5000 > $TMP/corpus/elseif.c
+
+# Compiles the whole corpus with a given compiler.
+compile_corpus() {
+    for src in $TMP/corpus/*.c; do
+        $1 -o /dev/null $src
+    done
+    (cd tests; ../$1 -I. -DANSWER=42 -o /dev/null tests.c)
+    for src in *.c; do
+        $1 $SYSINC -o /dev/null $src
+    done
+}
+
+# Prints the fastest of three runs in milliseconds.
+time_corpus() {
+    local best=
+    for i in 1 2 3; do
+        local start=$(date +%s%N)
+        compile_corpus $1
+        local end=$(date +%s%N)
+        local t=$(( (end - start) / 1000 ))
+        if [ -z "$best" ] || [ $t -lt $best ]; then
+            best=$t
+        fi
+    done
+    awk -v t=$best 'BEGIN { printf "%.3f", t / 1000 }'
+}
+
+# Prints the instruction and cycle counts of compiling the corpus, or
+# dashes if perf is not available.
+count_corpus() {
+    local out=$TMP/perf.out
+    if command -v perf > /dev/null &&
+       perf stat -x, -e instructions,cycles -o $out bash -c "$(declare -f compile_corpus); TMP=$TMP SYSINC='$SYSINC' compile_corpus $1" 2>/dev/null; then
+        awk -F, '$3 ~ /^instructions/ { i = $1 }
+                 $3 ~ /^cycles/ { c = $1 }
+                 END { printf "%s\t%s", (i ~ /^[0-9]+$/ ? i : "-"), (c ~ /^[0-9]+$/ ? c : "-") }' $out
+    else
+        printf -- "-\t-"
+    fi
+}
+
+printf "compiler\ttime_ms\tsize_bytes\ttext_bytes\tinstructions\tcycles\n" > $RESULTS
+for cc in $ZCC $STAGE2; do
+    # Make sure the compiler works on the corpus before timing it.
+    compile_corpus $cc
+
+    t=$(time_corpus $cc)
+    bytes=$(stat -c %s $cc)
+    text=$(size $cc | awk 'NR == 2 { print $1 }')
+    printf "%s\t%s\t%s\t%s\t%s\n" $(basename $cc) $t $bytes $text "$(count_corpus $cc)" >> $RESULTS
+done
+
+awk 'BEGIN { FS = "\t" } {
+    printf "%-12s %10s %12s %12s %16s %16s\n", $1, $2, $3, $4, $5, $6
+}' $RESULTS
+
+awk 'BEGIN { FS = "\t" }
+     NR == 2 { t = $2; s = $4; i = $5 }
+     NR == 3 {
+         printf "\nstage2/gcc   time %.2fx, text size %.2fx", $2 / t, $4 / s
+         if (i ~ /^[0-9]+$/ && $5 ~ /^[0-9]+$/)
+             printf ", instructions %.2fx", $5 / i
+         printf "\n"
+     }' $RESULTS
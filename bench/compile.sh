@@ -0,0 +1,94 @@
+#!/bin/bash
+# Measures the compile throughput of zcc on synthetic sources written
+# by bench/gen. Each source is compiled three times and the fastest
+# run is reported. The results are written as tab-separated values so
+# that they can be compared with a baseline from an earlier run.
+#
+# Usage: compile.sh <zcc> <gen> <tmpdir> <results> [<baseline>]
+set -e
+
+ZCC=$1
+GEN=$2
+TMP=$3
+RESULTS=$4
+BASELINE=$5
+
+SYSINC="-Iinclude -I/usr/local/include -I/usr/include -I/usr/include/linux -I/usr/include/x86_64-linux-gnu"
+
+# kind, scale
+BENCHMARKS="
+globals 4000
+macros 300
+initializers 10000
+functions 4000
+elseif 10000
+headers 1000
+"
+
+mkdir -p $TMP
+
+# Runs zcc once and prints the phase times in milliseconds and the
+# peak RSS in kilobytes. Only rows of the "phase" table are read, since
+# the same names appear in the tables of nested events. "tokenize" is
+# the main file; headers are tokenized as part of "preprocess".
+run() {
+    local src=$1 opts=$2
+    $ZCC $opts -ftime-report -fmem-report -o /dev/null $src 2>&1 >/dev/null |
+        awk '
+            $1 == "phase" { in_phase = 1; next }
+            NF == 0 { in_phase = 0 }
+            in_phase && $1 ~ /^(total|tokenize|preprocess|parse|codegen)$/ { t[$1] = $2 }
+            NF == 2 && $1 ~ /^(tokenize|preprocess|parse|codegen)$/ && $2 > rss { rss = $2 }
+            END {
+                printf "%.3f\t%.3f\t%.3f\t%.3f\t%.3f\t%d\n",
+                       t["tokenize"], t["preprocess"], t["parse"], t["codegen"], t["total"], rss
+            }'
+}
+
+printf "name\tlines\ttokenize_ms\tpreprocess_ms\tparse_ms\tcodegen_ms\ttotal_ms\tlines_per_sec\tpeak_rss_kb\n" > $RESULTS
+
+echo "$BENCHMARKS" | while read kind scale; do
+    [ -z "$kind" ] && continue
+    src=$TMP/$kind.c
+    $GEN $kind $scale > $src
+
+    # System headers can only be preprocessed, and their size is
+    # measured after preprocessing.
+    opts=
+    lines=$(wc -l < $src)
+    if [ $kind = headers ]; then
+        opts="-E $SYSINC"
+        lines=$($ZCC $opts $src | wc -l)
+    fi
+
+    best=
+    for i in 1 2 3; do
+        r=$(run $src "$opts")
+        if [ -z "$best" ] || awk -v a="$r" -v b="$best" 'BEGIN { split(a, x, "\t"); split(b, y, "\t"); exit !(x[5] < y[5]) }'; then
+            best=$r
+        fi
+    done
+
+    echo "$best" | awk -v kind=$kind -v lines=$lines 'BEGIN { FS = OFS = "\t" } {
+        lps = $5 > 0 ? lines / ($5 / 1000) : 0
+        print kind, lines, $1, $2, $3, $4, $5, int(lps), $6
+    }' >> $RESULTS
+done
+
+awk 'BEGIN { FS = "\t" } {
+    printf "%-14s %8s %12s %14s %9s %11s %9s %14s %12s\n", $1, $2, $3, $4, $5, $6, $7, $8, $9
+}' $RESULTS
+
+# Compare total times with the baseline. A benchmark that became more
+# than 10% slower is marked as a regression.
+if [ -n "$BASELINE" ] && [ -f "$BASELINE" ]; then
+    echo
+    echo "compared with $BASELINE:"
+    awk 'BEGIN { FS = "\t" }
+         NR == FNR { if (FNR > 1) base[$1] = $7; next }
+         FNR > 1 && ($1 in base) && base[$1] > 0 {
+             ratio = $7 / base[$1]
+             printf "  %-14s %8.3f ms -> %8.3f ms  %6.2fx%s\n", $1, base[$1], $7, ratio,
+                    (ratio > 1.1 ? "  REGRESSION" : "")
+         }' $BASELINE $RESULTS
+fi
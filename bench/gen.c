@@ -0,0 +1,165 @@
+// This program writes synthetic C sources for `make bench-compile`.
+// Each generator produces a realistic worst case for one part of the
+// compiler:
+//
+//   globals       many typedefs, structs and global variables
+//   macros        deeply nested macro expansions
+//   initializers  huge initializers for arrays and structs
+//   functions     thousands of small functions
+//   elseif        long else-if chains
+//   headers       a file that includes many C library headers
+//
+// Usage: gen <kind> <scale>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void gen_globals(int n) {
+    for (int i = 0; i < n; i++) {
+        printf("typedef struct S%d { int a; long b; char c[8]; struct S%d *next; } S%d;\n", i, i, i);
+        printf("typedef S%d *P%d;\n", i, i);
+        printf("typedef int (*F%d)(P%d, long);\n", i, i);
+        printf("S%d gs%d;\n", i, i);
+        printf("P%d gp%d = &gs%d;\n", i, i, i);
+        printf("int gi%d = %d;\n", i, i);
+        printf("static long gl%d[%d];\n", i, i % 16 + 1);
+        printf("extern char *gc%d;\n", i);
+    }
+    printf("int main() { return gs0.a + gi%d; }\n", n - 1);
+}
+
+static void gen_macros(int n) {
+    int depth = 64;
+
+    printf("#define A0(x) (x)\n");
+    for (int i = 1; i < depth; i++)
+        printf("#define A%d(x) A%d((x) + %d)\n", i, i - 1, i);
+
+    printf("#define B0 1\n");
+    for (int i = 1; i < depth; i++)
+        printf("#define B%d (B%d + A%d(%d))\n", i, i - 1, i % 8, i);
+
+    printf("#define CAT(x, y) x##y\n");
+    printf("#define STR(x) #x\n");
+    printf("#define CALL(f, ...) f(__VA_ARGS__)\n");
+
+    printf("int sink;\n");
+    printf("int main() {\n");
+    for (int i = 0; i < n; i++) {
+        printf("    sink += A%d(%d);\n", depth - 1, i);
+        printf("    sink += B%d;\n", i % depth);
+        printf("    sink += CALL(A%d, CAT(1, %d));\n", i % depth, i);
+        printf("    sink += sizeof(STR(A%d(%d)));\n", i % depth, i);
+    }
+    printf("    return 0;\n}\n");
+}
+
+static void gen_initializers(int n) {
+    printf("int ints[%d] = {", n * 8);
+    for (int i = 0; i < n * 8; i++)
+        printf("%s%d", i ? ", " : "", i * 7 % 1000);
+    printf("};\n");
+
+    printf("struct P { int x; double y; char *s; short t[4]; };\n");
+    printf("struct P ps[%d] = {\n", n);
+    for (int i = 0; i < n; i++)
+        printf("    {%d, %d.5, \"str%d\", {%d, %d}},\n", i, i, i, i, -i);
+    printf("};\n");
+
+    printf("char *strs[] = {\n");
+    for (int i = 0; i < n; i++)
+        printf("    \"string number %d\",\n", i);
+    printf("};\n");
+
+    printf("int grid[%d][16] = {\n", n / 4 + 1);
+    for (int i = 0; i < n / 4 + 1; i++)
+        printf("    {%d, %d, %d, 0, 0, 0, 0, 0, %d, %d},\n", i, i + 1, i + 2, i * 2, i * 3);
+    printf("};\n");
+
+    printf("int main() {\n");
+    printf("    int local[%d] = {", n);
+    for (int i = 0; i < n; i++)
+        printf("%s%d", i ? ", " : "", i);
+    printf("};\n");
+    printf("    return local[0] + ints[0] + ps[0].x + grid[0][0];\n}\n");
+}
+
+static void gen_functions(int n) {
+    printf("int printf(char *fmt, ...);\n");
+    for (int i = 0; i < n; i++) {
+        printf("static int f%d(int a, long b, char *p) {\n", i);
+        printf("    int sum = 0;\n");
+        printf("    for (int i = 0; i < a; i++) {\n");
+        printf("        if (p[i] == %d)\n", i % 128);
+        printf("            sum += i * %d;\n", i);
+        printf("        else\n");
+        printf("            sum -= b / (i + 1);\n");
+        printf("    }\n");
+        if (i > 0)
+            printf("    sum += f%d(a - 1, b + sum, p);\n", i - 1);
+        printf("    return sum;\n}\n");
+    }
+    printf("int main() { return f%d(0, 0, \"\"); }\n", n - 1);
+}
+
+static void gen_elseif(int n) {
+    int chain = 500;
+
+    for (int f = 0; f < n / chain + 1; f++) {
+        printf("int classify%d(int x) {\n", f);
+        printf("    int y = 0;\n");
+        printf("    if (x == 0)\n        y = 1;\n");
+        for (int i = 1; i < chain; i++)
+            printf("    else if (x == %d)\n        y = x * %d + %d;\n", i, i, f);
+        printf("    else\n        y = -1;\n");
+        printf("    return y;\n}\n");
+    }
+    printf("int main() { return classify0(3); }\n");
+}
+
+static void gen_headers(int n) {
+    static char *headers[] = {
+        "assert.h", "ctype.h", "errno.h", "fenv.h", "limits.h", "locale.h",
+        "setjmp.h", "signal.h", "stdarg.h", "stddef.h", "stdio.h",
+        "stdlib.h", "string.h", "time.h", "fcntl.h", "unistd.h", "dirent.h",
+        "pthread.h", "sys/types.h", "sys/stat.h", "sys/mman.h", "sys/wait.h",
+        "sys/time.h", "sys/resource.h", "poll.h", "sched.h", "semaphore.h",
+        "termios.h",
+    };
+
+    // Include the headers `n` times in total so that most inclusions
+    // hit include guards, as they do in real programs.
+    int nheaders = sizeof(headers) / sizeof(*headers);
+    for (int i = 0; i < n; i++)
+        printf("#include <%s>\n", headers[i % nheaders]);
+    printf("int main() { return 0; }\n");
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: gen <kind> <scale>\n");
+        return 1;
+    }
+
+    char *kind = argv[1];
+    int n = atoi(argv[2]);
+
+    if (!strcmp(kind, "globals"))
+        gen_globals(n);
+    else if (!strcmp(kind, "macros"))
+        gen_macros(n);
+    else if (!strcmp(kind, "initializers"))
+        gen_initializers(n);
+    else if (!strcmp(kind, "functions"))
+        gen_functions(n);
+    else if (!strcmp(kind, "elseif"))
+        gen_elseif(n);
+    else if (!strcmp(kind, "headers"))
+        gen_headers(n);
+    else {
+        fprintf(stderr, "unknown kind: %s\n", kind);
+        return 1;
+    }
+    return 0;
+}
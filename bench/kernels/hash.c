@@ -0,0 +1,69 @@
+// Open-addressing hash table with FNV-1a hashing of string keys
+
+int printf(const char *fmt, ...);
+int sprintf(char *buf, const char *fmt, ...);
+
+#define CAPACITY 262144
+#define NKEYS 150000
+
+char keys[CAPACITY][16];
+int values[CAPACITY];
+char used[CAPACITY];
+
+unsigned fnv1a(char *s) {
+    unsigned h = 2166136261;
+    for (; *s; s++) {
+        h = h ^ (unsigned char)*s;
+        h = h * 16777619;
+    }
+    return h;
+}
+
+int streq(char *a, char *b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+void strcopy(char *dst, char *src) {
+    while (*src)
+        *dst++ = *src++;
+    *dst = 0;
+}
+
+int *lookup(char *key, int insert) {
+    unsigned i = fnv1a(key) & (CAPACITY - 1);
+    while (used[i]) {
+        if (streq(keys[i], key))
+            return &values[i];
+        i = (i + 1) & (CAPACITY - 1);
+    }
+    if (!insert)
+        return 0;
+    used[i] = 1;
+    strcopy(keys[i], key);
+    values[i] = 0;
+    return &values[i];
+}
+
+int main() {
+    char buf[32];
+    long sum = 0;
+
+    for (int rep = 0; rep < 4; rep++) {
+        for (int i = 0; i < NKEYS; i++) {
+            sprintf(buf, "key%d", i * 7 % NKEYS);
+            *lookup(buf, 1) += i;
+        }
+        for (int i = 0; i < NKEYS; i += 3) {
+            sprintf(buf, "key%d", i);
+            int *v = lookup(buf, 0);
+            if (v)
+                sum = sum + *v % 1000;
+        }
+    }
+    printf("%ld\n", sum);
+    return 0;
+}
@@ -0,0 +1,104 @@
+// A bytecode interpreter for a small stack machine
+
+int printf(const char *fmt, ...);
+
+enum {
+    OP_PUSH, OP_LOAD, OP_STORE, OP_ADD, OP_SUB, OP_MUL, OP_MOD,
+    OP_LT, OP_JZ, OP_JMP, OP_HALT,
+};
+
+int code[64];
+long vars[8];
+long stack[64];
+
+int emit_pos;
+
+void emit(int op, int arg) {
+    code[emit_pos++] = op;
+    code[emit_pos++] = arg;
+}
+
+long run() {
+    int pc = 0;
+    int sp = 0;
+
+    for (;;) {
+        int op = code[pc];
+        int arg = code[pc + 1];
+        pc += 2;
+
+        switch (op) {
+        case OP_PUSH:
+            stack[sp++] = arg;
+            break;
+        case OP_LOAD:
+            stack[sp++] = vars[arg];
+            break;
+        case OP_STORE:
+            vars[arg] = stack[--sp];
+            break;
+        case OP_ADD:
+            sp--;
+            stack[sp - 1] = stack[sp - 1] + stack[sp];
+            break;
+        case OP_SUB:
+            sp--;
+            stack[sp - 1] = stack[sp - 1] - stack[sp];
+            break;
+        case OP_MUL:
+            sp--;
+            stack[sp - 1] = stack[sp - 1] * stack[sp];
+            break;
+        case OP_MOD:
+            sp--;
+            stack[sp - 1] = stack[sp - 1] % stack[sp];
+            break;
+        case OP_LT:
+            sp--;
+            stack[sp - 1] = stack[sp - 1] < stack[sp];
+            break;
+        case OP_JZ:
+            if (!stack[--sp])
+                pc = arg;
+            break;
+        case OP_JMP:
+            pc = arg;
+            break;
+        case OP_HALT:
+            return vars[1];
+        }
+    }
+}
+
+int main() {
+    // i = 0; sum = 0;
+    // while (i < 3000000) { sum = (sum * 31 + i) % 1000003; i = i + 1; }
+    emit(OP_PUSH, 0);
+    emit(OP_STORE, 0);
+    emit(OP_PUSH, 0);
+    emit(OP_STORE, 1);
+    int loop = emit_pos;
+    emit(OP_LOAD, 0);
+    emit(OP_PUSH, 3000000);
+    emit(OP_LT, 0);
+    int jz = emit_pos;
+    emit(OP_JZ, 0);
+    emit(OP_LOAD, 1);
+    emit(OP_PUSH, 31);
+    emit(OP_MUL, 0);
+    emit(OP_LOAD, 0);
+    emit(OP_ADD, 0);
+    emit(OP_PUSH, 1000003);
+    emit(OP_MOD, 0);
+    emit(OP_STORE, 1);
+    emit(OP_LOAD, 0);
+    emit(OP_PUSH, 1);
+    emit(OP_ADD, 0);
+    emit(OP_STORE, 0);
+    emit(OP_JMP, loop);
+    code[jz + 1] = emit_pos;
+    emit(OP_HALT, 0);
+
+    printf("%ld\n", run());
+    return 0;
+}
@@ -0,0 +1,36 @@
+// Naive matrix multiplication of doubles
+
+int printf(const char *fmt, ...);
+
+#define N 160
+
+double a[N][N];
+double b[N][N];
+double c[N][N];
+
+int main() {
+    for (int i = 0; i < N; i++) {
+        for (int j = 0; j < N; j++) {
+            a[i][j] = (i * 7 + j * 3) % 17 / 4.0;
+            b[i][j] = (i * 5 + j * 11) % 13 / 8.0;
+        }
+    }
+
+    for (int rep = 0; rep < 4; rep++) {
+        for (int i = 0; i < N; i++) {
+            for (int j = 0; j < N; j++) {
+                double sum = 0;
+                for (int k = 0; k < N; k++)
+                    sum = sum + a[i][k] * b[k][j];
+                c[i][j] = sum;
+            }
+        }
+    }
+
+    double sum = 0;
+    for (int i = 0; i < N; i++)
+        for (int j = 0; j < N; j++)
+            sum = sum + c[i][j] * (i + j);
+    printf("%.6e\n", sum);
+    return 0;
+}
@@ -0,0 +1,74 @@
+// Quicksort and insertion sort of pseudo-random integers
+
+int printf(const char *fmt, ...);
+
+#define N 400000
+
+int data[N];
+unsigned seed = 12345;
+
+unsigned next_rand() {
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+void insertion_sort(int *a, int lo, int hi) {
+    for (int i = lo + 1; i <= hi; i++) {
+        int x = a[i];
+        int j = i - 1;
+        while (j >= lo && a[j] > x) {
+            a[j + 1] = a[j];
+            j--;
+        }
+        a[j + 1] = x;
+    }
+}
+
+void quicksort(int *a, int lo, int hi) {
+    while (hi - lo > 16) {
+        int pivot = a[lo + (hi - lo) / 2];
+        int i = lo;
+        int j = hi;
+        while (i <= j) {
+            while (a[i] < pivot)
+                i++;
+            while (a[j] > pivot)
+                j--;
+            if (i <= j) {
+                int t = a[i];
+                a[i] = a[j];
+                a[j] = t;
+                i++;
+                j--;
+            }
+        }
+        if (j - lo < hi - i) {
+            quicksort(a, lo, j);
+            lo = i;
+        } else {
+            quicksort(a, i, hi);
+            hi = j;
+        }
+    }
+    insertion_sort(a, lo, hi);
+}
+
+int main() {
+    long sum = 0;
+    for (int rep = 0; rep < 3; rep++) {
+        for (int i = 0; i < N; i++)
+            data[i] = next_rand() % 1000000;
+        quicksort(data, 0, N - 1);
+
+        for (int i = 1; i < N; i++) {
+            if (data[i - 1] > data[i]) {
+                printf("not sorted\n");
+                return 1;
+            }
+        }
+        for (int i = 0; i < N; i += 97)
+            sum = sum + data[i];
+    }
+    printf("%ld\n", sum);
+    return 0;
+}
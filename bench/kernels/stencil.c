@@ -0,0 +1,31 @@
+// Jacobi iteration of a 5-point stencil on a 2D grid of doubles
+
+int printf(const char *fmt, ...);
+
+#define N 256
+
+double grid[N][N];
+double next[N][N];
+
+int main() {
+    for (int i = 0; i < N; i++)
+        for (int j = 0; j < N; j++)
+            grid[i][j] = (i == 0 || j == 0) ? 100.0 : 0.0;
+
+    for (int iter = 0; iter < 60; iter++) {
+        for (int i = 1; i < N - 1; i++)
+            for (int j = 1; j < N - 1; j++)
+                next[i][j] = 0.25 * (grid[i - 1][j] + grid[i + 1][j] +
+                                     grid[i][j - 1] + grid[i][j + 1]);
+        for (int i = 1; i < N - 1; i++)
+            for (int j = 1; j < N - 1; j++)
+                grid[i][j] = next[i][j];
+    }
+
+    double sum = 0;
+    for (int i = 0; i < N; i++)
+        for (int j = 0; j < N; j++)
+            sum = sum + grid[i][j];
+    printf("%.6e\n", sum);
+    return 0;
+}
@@ -0,0 +1,54 @@
+// Scanning text: counting words and lines and naive substring search
+
+int printf(const char *fmt, ...);
+
+#define SIZE 2000000
+
+char text[SIZE + 1];
+
+int is_space(int c) {
+    return c == ' ' || c == '\n' || c == '\t';
+}
+
+int main() {
+    char *words[] = {"alpha", "beta", "gamma", "delta", "epsilon", "zeta", "eta", "theta"};
+    unsigned seed = 1;
+    int len = 0;
+
+    // Build the text from pseudo-random words.
+    while (len < SIZE - 16) {
+        seed = seed * 1103515245 + 12345;
+        char *w = words[(seed >> 16) % 8];
+        while (*w)
+            text[len++] = *w++;
+        text[len++] = (seed >> 8) % 11 == 0 ? '\n' : ' ';
+    }
+    text[len] = 0;
+
+    long nwords = 0, nlines = 0, nmatches = 0, checksum = 0;
+    for (int rep = 0; rep < 5; rep++) {
+        int in_word = 0;
+        for (char *p = text; *p; p++) {
+            if (*p == '\n')
+                nlines++;
+            if (is_space(*p)) {
+                in_word = 0;
+            } else if (!in_word) {
+                in_word = 1;
+                nwords++;
+            }
+            checksum = checksum * 31 + *p;
+        }
+
+        char *pat = "theta eta";
+        for (char *p = text; *p; p++) {
+            int i = 0;
+            while (pat[i] && p[i] == pat[i])
+                i++;
+            if (!pat[i])
+                nmatches++;
+        }
+    }
+    printf("%ld %ld %ld %ld\n", nwords, nlines, nmatches, checksum);
+    return 0;
+}
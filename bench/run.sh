@@ -0,0 +1,75 @@
+#!/bin/bash
+# Measures the speed of code generated by zcc. Each kernel is compiled
+# by zcc and by gcc -O0 and -O2, the outputs of the three executables
+# are checked to be identical, and each executable is run three times
+# with the fastest run reported. The results are written as
+# tab-separated values along with the ratios of the zcc run time to
+# the gcc run times.
+#
+# Usage: run.sh <zcc> <tmpdir> <results> <kernel.c>...
+set -e
+
+ZCC=$1
+TMP=$2
+RESULTS=$3
+shift 3
+
+mkdir -p $TMP
+
+# Runs an executable three times and prints the fastest run time in
+# milliseconds.
+run() {
+    local best=
+    for i in 1 2 3; do
+        local start=$(date +%s%N)
+        $1 > /dev/null
+        local end=$(date +%s%N)
+        local t=$(( (end - start) / 1000 ))
+        if [ -z "$best" ] || [ $t -lt $best ]; then
+            best=$t
+        fi
+    done
+    awk -v t=$best 'BEGIN { printf "%.3f", t / 1000 }'
+}
+
+printf "name\tzcc_ms\tgcc_O0_ms\tgcc_O2_ms\tvs_O0\tvs_O2\n" > $RESULTS
+
+for src in "$@"; do
+    name=$(basename $src .c)
+
+    $ZCC -o $TMP/$name.s $src
+    gcc -static -Wl,-z,noexecstack -o $TMP/$name.zcc $TMP/$name.s
+    gcc -w -O0 -static -o $TMP/$name.O0 $src
+    gcc -w -O2 -static -o $TMP/$name.O2 $src
+
+    $TMP/$name.zcc > $TMP/$name.zcc.out
+    for opt in O0 O2; do
+        $TMP/$name.$opt > $TMP/$name.$opt.out
+        if ! cmp -s $TMP/$name.zcc.out $TMP/$name.$opt.out; then
+            echo "$name: output differs from gcc -$opt"
+            exit 1
+        fi
+    done
+
+    zcc_ms=$(run $TMP/$name.zcc)
+    O0_ms=$(run $TMP/$name.O0)
+    O2_ms=$(run $TMP/$name.O2)
+
+    awk -v name=$name -v z=$zcc_ms -v a=$O0_ms -v b=$O2_ms 'BEGIN {
+        printf "%s\t%s\t%s\t%s\t%.2f\t%.2f\n", name, z, a, b,
+               (a > 0 ? z / a : 0), (b > 0 ? z / b : 0)
+    }' >> $RESULTS
+done
+
+awk 'BEGIN { FS = "\t" } {
+    printf "%-10s %10s %10s %10s %7s %7s\n", $1, $2, $3, $4, $5, $6
+}' $RESULTS
+
+# Geometric means of the ratios, which summarize the suite in a
+# single number per compiler.
+awk 'BEGIN { FS = "\t" }
+     NR > 1 && $5 > 0 && $6 > 0 { a += log($5); b += log($6); n++ }
+     END {
+         if (n)
+             printf "%-10s %32s %7.2f %7.2f\n", "geomean", "", exp(a / n), exp(b / n)
+     }' $RESULTS
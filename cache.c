@@ -0,0 +1,231 @@
+// This file implements a content-addressed compilation cache.
+//
+// The output of parse() and codegen() depends only on the
+// preprocessed token stream and a few options, so we can key the
+// generated assembly by a digest of those. The key also covers the
+// size and modification time of the zcc binary itself, so that
+// rebuilding the compiler invalidates old entries.
+//
+// Entries are written to a temporary file first and then renamed,
+// so concurrent compilations sharing a cache directory never see a
+// partially written entry.
+//
+// Only the assembly is stored. A hit skips parse() and codegen() and
+// their warnings, so a translation unit that got any warnings is not
+// cached; compiling it again reports them again.
+
+#include "zcc.h"
+
+char *cache_dir;
+
+//
+// SHA-256
+//
+
+typedef struct {
+    unsigned int h[8];
+    unsigned char buf[64];
+    int buflen;
+    long total;
+} Sha256;
+
+static unsigned int sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static unsigned int rotr(unsigned int x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+static void sha256_init(Sha256 *s) {
+    unsigned int h[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    memcpy(s->h, h, sizeof(h));
+    s->buflen = 0;
+    s->total = 0;
+}
+
+static void sha256_block(Sha256 *s, unsigned char *p) {
+    unsigned int w[64];
+    for (int i = 0; i < 16; i++)
+        w[i] = (p[i * 4] << 24) | (p[i * 4 + 1] << 16) | (p[i * 4 + 2] << 8) | p[i * 4 + 3];
+    for (int i = 16; i < 64; i++) {
+        unsigned int s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        unsigned int s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    unsigned int a = s->h[0], b = s->h[1], c = s->h[2], d = s->h[3];
+    unsigned int e = s->h[4], f = s->h[5], g = s->h[6], h = s->h[7];
+
+    for (int i = 0; i < 64; i++) {
+        unsigned int t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) +
+                          ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        unsigned int t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) +
+                          ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    s->h[0] += a; s->h[1] += b; s->h[2] += c; s->h[3] += d;
+    s->h[4] += e; s->h[5] += f; s->h[6] += g; s->h[7] += h;
+}
+
+static void sha256_update(Sha256 *s, void *data, long len) {
+    unsigned char *p = data;
+    s->total += len;
+
+    while (len > 0) {
+        int n = 64 - s->buflen;
+        if (n > len)
+            n = len;
+        memcpy(s->buf + s->buflen, p, n);
+        s->buflen += n;
+        p += n;
+        len -= n;
+
+        if (s->buflen == 64) {
+            sha256_block(s, s->buf);
+            s->buflen = 0;
+        }
+    }
+}
+
+static void sha256_final(Sha256 *s, unsigned char *out) {
+    long bits = s->total * 8;
+    unsigned char pad = 0x80;
+    sha256_update(s, &pad, 1);
+    pad = 0;
+    while (s->buflen != 56)
+        sha256_update(s, &pad, 1);
+
+    unsigned char len[8];
+    for (int i = 0; i < 8; i++)
+        len[i] = bits >> (56 - i * 8);
+    sha256_update(s, len, 8);
+
+    for (int i = 0; i < 32; i++)
+        out[i] = s->h[i / 4] >> (24 - (i % 4) * 8);
+}
+
+//
+// Cache
+//
+
+static char *tmp_path;
+static char *entry_path;
+static int saved_stdout = -1;
+
+// warning_count when the cache was missed
+static int miss_warnings;
+
+static void hash_int(Sha256 *s, long val) {
+    sha256_update(s, &val, sizeof(val));
+}
+
+// Returns the path of the cache entry for a given preprocessed
+// token stream.
+char *cache_entry(Token *tok) {
+    Sha256 s;
+    sha256_init(&s);
+
+    // Identify the compiler binary.
+    struct stat st;
+    if (stat("/proc/self/exe", &st) == 0) {
+        hash_int(&s, st.st_size);
+        hash_int(&s, st.st_mtime);
+    }
+
+    // Options that affect code generation
+    hash_int(&s, opt_fpic);
+    hash_int(&s, opt_g);
+    hash_int(&s, opt_regalloc);
+
+    // Tokens, including the locations used by .loc directives
+    for (; tok->kind != TK_EOF; tok = tok->next) {
+        hash_int(&s, tok->kind);
+        hash_int(&s, get_source_file(tok)->file_no);
+        hash_int(&s, tok->line_no);
+        hash_int(&s, tok->len);
+        sha256_update(&s, tok->loc, tok->len);
+    }
+
+    unsigned char digest[32];
+    sha256_final(&s, digest);
+
+    char *path = malloc(strlen(cache_dir) + 70);
+    int len = sprintf(path, "%s/", cache_dir);
+    for (int i = 0; i < 32; i++)
+        len += sprintf(path + len, "%02x", digest[i]);
+    strcpy(path + len, ".s");
+    return path;
+}
+
+static void copy_to_stdout(FILE *in) {
+    char buf[8192];
+    int n;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
+        fwrite(buf, 1, n, stdout);
+}
+
+// Writes a cache entry to stdout. Returns false if there's no entry.
+bool cache_read(char *path) {
+    FILE *in = fopen(path, "r");
+    if (!in) {
+        miss_warnings = warning_count;
+        return false;
+    }
+    copy_to_stdout(in);
+    fclose(in);
+    return true;
+}
+
+// Starts capturing stdout so that it can be stored as a new entry.
+void cache_begin(char *path) {
+    mkdir(cache_dir, 0777);
+
+    tmp_path = malloc(strlen(path) + 30);
+    sprintf(tmp_path, "%s.%d.tmp", path, getpid());
+    int fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1)
+        error("cannot create %s: %s", tmp_path, strerror(errno));
+
+    fflush(stdout);
+    saved_stdout = dup(STDOUT_FILENO);
+    dup2(fd, STDOUT_FILENO);
+    close(fd);
+    entry_path = path;
+}
+
+// Stops capturing, copies the captured output to the real stdout
+// and installs it as a cache entry unless there were warnings.
+void cache_end(void) {
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    FILE *in = fopen(tmp_path, "r");
+    if (!in)
+        error("cannot open %s: %s", tmp_path, strerror(errno));
+    copy_to_stdout(in);
+    fclose(in);
+    fflush(stdout);
+
+    if (warning_count != miss_warnings || rename(tmp_path, entry_path))
+        unlink(tmp_path);
+}
@@ -10,21 +10,156 @@ static char *argreg32[] = {"edi", "esi", "edx", "ecx", "r8d", "r9d"};
 static char *argreg64[] = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
 static Function *current_fn; // = NULL
 
-static char *reg(int idx) {
-    static char *r[] = {"r10", "r11", "r12", "r13", "r14", "r15"};
-    if (idx < 0 || sizeof(r) / sizeof(*r) <= idx)
+//
+// Output buffer
+//
+// Assembly text is accumulated in a large buffer and handed to the
+// kernel with write(2) when the buffer fills up. emit() understands
+// only the conversions used in this file (%s, %d, %u, %ld, %lu and
+// %+ld), so it's much cheaper than printf().
+//
+
+#define OUTBUF_SIZE (1 << 16)
+
+static char outbuf[OUTBUF_SIZE];
+static int outlen;
+
+static void flush_output(void) {
+    char *p = outbuf;
+    while (outlen > 0) {
+        long n = write(STDOUT_FILENO, p, outlen);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            error("write failed: %s", strerror(errno));
+        }
+        p += n;
+        outlen -= n;
+    }
+}
+
+static void emit_bytes(char *s, int len) {
+    while (outlen + len > OUTBUF_SIZE) {
+        int n = OUTBUF_SIZE - outlen;
+        memcpy(outbuf + outlen, s, n);
+        outlen += n;
+        s += n;
+        len -= n;
+        flush_output();
+    }
+    memcpy(outbuf + outlen, s, len);
+    outlen += len;
+}
+
+static void emit_str(char *s) {
+    emit_bytes(s, strlen(s));
+}
+
+static void emit_char(char c) {
+    if (outlen == OUTBUF_SIZE)
+        flush_output();
+    outbuf[outlen++] = c;
+}
+
+static void emit_ulong(unsigned long val) {
+    char buf[20];
+    int i = sizeof(buf);
+    do {
+        buf[--i] = '0' + val % 10;
+        val /= 10;
+    } while (val);
+    emit_bytes(buf + i, sizeof(buf) - i);
+}
+
+static void emit_long(long val) {
+    if (val < 0) {
+        emit_char('-');
+        emit_ulong(-(unsigned long)val);
+        return;
+    }
+    emit_ulong(val);
+}
+
+static void emit(char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+
+    for (;;) {
+        char *p = strchr(fmt, '%');
+        if (!p) {
+            emit_str(fmt);
+            break;
+        }
+        emit_bytes(fmt, p - fmt);
+        p++;
+
+        bool plus = false;
+        if (*p == '+') {
+            plus = true;
+            p++;
+        }
+
+        if (*p == 's') {
+            emit_str(va_arg(ap, char *));
+        } else if (*p == 'd') {
+            emit_long(va_arg(ap, int));
+        } else if (*p == 'u') {
+            emit_ulong(va_arg(ap, unsigned int));
+        } else if (p[0] == 'l' && p[1] == 'd') {
+            long val = va_arg(ap, long);
+            if (plus && val >= 0)
+                emit_char('+');
+            emit_long(val);
+            p++;
+        } else if (p[0] == 'l' && p[1] == 'u') {
+            emit_ulong(va_arg(ap, unsigned long));
+            p++;
+        } else {
+            error("internal error: bad format: %s", fmt);
+        }
+        fmt = p + 1;
+    }
+
+    va_end(ap);
+}
+
+// Expressions are evaluated on a stack of caller-saved registers, so
+// that the callee-saved ones are free for variables. Live entries of
+// the stack are saved around function calls.
+static char *reg64[] = {"r10", "r11", "r8", "r9", "rsi", "rdi"};
+static char *reg32[] = {"r10d", "r11d", "r8d", "r9d", "esi", "edi"};
+static char *reg16[] = {"r10w", "r11w", "r8w", "r9w", "si", "di"};
+static char *reg8[] = {"r10b", "r11b", "r8b", "r9b", "sil", "dil"};
+
+// Registers for variables chosen by regalloc.c. Var::reg is an index
+// into these tables plus one. The GPRs are callee-saved and are saved
+// by the prologue. All XMM registers are caller-saved, so variables in
+// them are saved around function calls instead.
+static char *var_reg64[] = {"rbx", "r12", "r13", "r14", "r15"};
+static char *var_reg32[] = {"ebx", "r12d", "r13d", "r14d", "r15d"};
+static char *var_xreg[] = {"xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7", "xmm14", "xmm15"};
+
+// Returns the name of a given size of a register of the stack.
+static char *sized_reg(int idx, int sz) {
+    if (idx < 0 || sizeof(reg64) / sizeof(*reg64) <= idx)
         error("register out of range: %d", idx);
-    return r[idx];
+    if (sz == 1)
+        return reg8[idx];
+    if (sz == 2)
+        return reg16[idx];
+    if (sz == 4)
+        return reg32[idx];
+    return reg64[idx];
+}
+
+static char *reg(int idx) {
+    return sized_reg(idx, 8);
 }
 
 static char *xreg(Type *ty, int idx) {
     if (ty->base || size_of(ty) == 8)
         return reg(idx);
-    
-    static char *r[] = {"r10d", "r11d", "r12d", "r13d", "r14d", "r15d"};
-    if (idx < 0 || sizeof(r) / sizeof(*r) <= idx)
-        error("register out of range: %d", idx);
-    return r[idx];
+    return sized_reg(idx, 4);
 }
 
 static char *freg(int idx) {
@@ -41,14 +176,16 @@ static void gen_stmt(Node *node);
 static void gen_addr(Node *node) {
     switch (node->kind) {
     case ND_VAR:
+        if (node->var->reg)
+            error_tok(node->tok, "internal error: address of a register variable");
         if (node->var->is_local)
-            printf("  lea %s, [rbp-%d]\n", reg(top++), node->var->offset);
+            emit("  lea %s, [rbp-%d]\n", reg(top++), node->var->offset);
         else if (!opt_fpic)
-            printf("  mov %s, offset %s\n", reg(top++), node->var->name);
+            emit("  mov %s, offset %s\n", reg(top++), node->var->name);
         else if (node->var->is_static)
-            printf("  lea %s, %s[rip]\n", reg(top++), node->var->name);
+            emit("  lea %s, %s[rip]\n", reg(top++), node->var->name);
         else
-            printf("  mov %s, qword ptr %s@GOTPCREL[rip]\n", reg(top++), node->var->name);
+            emit("  mov %s, qword ptr %s@GOTPCREL[rip]\n", reg(top++), node->var->name);
         return;
     case ND_DEREF:
         gen_expr(node->lhs);
@@ -60,7 +197,7 @@ static void gen_addr(Node *node) {
         return;
     case ND_MEMBER:
         gen_addr(node->lhs);
-        printf("  add %s, %d\n", reg(top - 1), node->member->offset);
+        emit("  add %s, %d\n", reg(top - 1), node->member->offset);
         return;
     }
 
@@ -80,12 +217,12 @@ static void load(Type *ty) {
     }
 
     if (ty->kind == TY_FLOAT) {
-        printf("  movss %s, [%s]\n", freg(top - 1), reg(top - 1));
+        emit("  movss %s, [%s]\n", freg(top - 1), reg(top - 1));
         return;
     }
 
     if (ty->kind == TY_DOUBLE) {
-        printf("  movsd %s, [%s]\n", freg(top - 1), reg(top - 1));
+        emit("  movsd %s, [%s]\n", freg(top - 1), reg(top - 1));
         return;
     }
 
@@ -100,13 +237,13 @@ static void load(Type *ty) {
     // a long value to a register, it simply occupies the entire register.
     int sz = size_of(ty);
     if (sz == 1)
-        printf("  %s %s, byte ptr [%s]\n", insn, rd, rs);
+        emit("  %s %s, byte ptr [%s]\n", insn, rd, rs);
     else if (sz == 2)
-        printf("  %s %s, word ptr [%s]\n", insn, rd, rs);
+        emit("  %s %s, word ptr [%s]\n", insn, rd, rs);
     else if (sz == 4)
-        printf("  mov %s, dword ptr [%s]\n", rd, rs);
+        emit("  mov %s, dword ptr [%s]\n", rd, rs);
     else
-        printf("  mov %s, [%s]\n", rd, rs);
+        emit("  mov %s, [%s]\n", rd, rs);
 }
 
 static void store(Type *ty) {
@@ -116,35 +253,62 @@ static void store(Type *ty) {
 
     if (ty->kind == TY_STRUCT) {
         for (int i = 0; i < sz; i++) {
-            printf("  mov al, [%s+%d]\n", rs, i);
-            printf("  mov [%s+%d], al\n", rd, i);
+            emit("  mov al, [%s+%d]\n", rs, i);
+            emit("  mov [%s+%d], al\n", rd, i);
         }
     } else if (ty->kind == TY_FLOAT) {
-        printf("  movss [%s], %s\n", rd, freg(top - 2));
+        emit("  movss [%s], %s\n", rd, freg(top - 2));
     } else if (ty->kind == TY_DOUBLE) {
-        printf("  movsd [%s], %s\n", rd, freg(top - 2));
-    } else if (sz == 1) {
-        printf("  mov [%s], %sb\n", rd, rs);
-    } else if (sz == 2) {
-        printf("  mov [%s], %sw\n", rd, rs);
-    } else if (sz == 4) {
-        printf("  mov [%s], %sd\n", rd, rs);
+        emit("  movsd [%s], %s\n", rd, freg(top - 2));
+    } else if (sz == 1 || sz == 2 || sz == 4) {
+        emit("  mov [%s], %s\n", rd, sized_reg(top - 2, sz));
     } else {
-        printf("  mov [%s], %s\n", rd, rs);
+        emit("  mov [%s], %s\n", rd, rs);
     }
     
     top--;
 }
 
+// Pushes the value of a variable that lives in a register.
+static void load_var_reg(Var *var) {
+    if (var->ty->kind == TY_FLOAT)
+        emit("  movss %s, %s\n", freg(top++), var_xreg[var->reg - 1]);
+    else if (var->ty->kind == TY_DOUBLE)
+        emit("  movsd %s, %s\n", freg(top++), var_xreg[var->reg - 1]);
+    else
+        emit("  mov %s, %s\n", reg(top++), var_reg64[var->reg - 1]);
+}
+
+// Copies the stack top to a variable that lives in a register. The
+// value stays on the stack as the result of the assignment. As with
+// load(), chars and shorts are extended to int.
+static void store_var_reg(Var *var) {
+    Type *ty = var->ty;
+    int r = var->reg - 1;
+    int sz = size_of(ty);
+    char *insn = ty->is_unsigned ? "movzx" : "movsx";
+
+    if (ty->kind == TY_FLOAT)
+        emit("  movss %s, %s\n", var_xreg[r], freg(top - 1));
+    else if (ty->kind == TY_DOUBLE)
+        emit("  movsd %s, %s\n", var_xreg[r], freg(top - 1));
+    else if (sz == 1 || sz == 2)
+        emit("  %s %s, %s\n", insn, var_reg32[r], sized_reg(top - 1, sz));
+    else if (sz == 4)
+        emit("  mov %s, %s\n", var_reg32[r], sized_reg(top - 1, 4));
+    else
+        emit("  mov %s, %s\n", var_reg64[r], reg(top - 1));
+}
+
 static void cmp_zero(Type *ty) {
     if (ty->kind == TY_FLOAT) {
-        printf("  xorps xmm0, xmm0\n"); // Perform bitwise logical XOR of packed single-precision floating-point values.
-        printf("  ucomiss %s, xmm0\n", freg(--top)); // Perform unordered comparison of scalar single-precision floating-point values and set flags in EFLAGS register.
+        emit("  xorps xmm0, xmm0\n"); // Perform bitwise logical XOR of packed single-precision floating-point values.
+        emit("  ucomiss %s, xmm0\n", freg(--top)); // Perform unordered comparison of scalar single-precision floating-point values and set flags in EFLAGS register.
     } else if (ty->kind == TY_DOUBLE) {
-        printf("  xorpd xmm0, xmm0\n"); // Perform bitwise logical XOR of packed double-precision floating-point values.
-        printf("  ucomisd %s, xmm0\n", freg(--top)); // Perform unordered comparison of scalar double-precision floating-point values and set flags in EFLAGS register.
+        emit("  xorpd xmm0, xmm0\n"); // Perform bitwise logical XOR of packed double-precision floating-point values.
+        emit("  ucomisd %s, xmm0\n", freg(--top)); // Perform unordered comparison of scalar double-precision floating-point values and set flags in EFLAGS register.
     } else {
-        printf("  cmp %s, 0\n", reg(--top));
+        emit("  cmp %s, 0\n", reg(--top));
     }
 }
 
@@ -157,8 +321,8 @@ static void cast(Type *from, Type *to) {
 
     if (to->kind == TY_BOOL) {
         cmp_zero(from);
-        printf("  setne %sb\n", reg(top));
-        printf("  movzx %s, %sb\n", reg(top), reg(top));
+        emit("  setne %s\n", sized_reg(top, 1));
+        emit("  movzx %s, %s\n", reg(top), sized_reg(top, 1));
         top++;
         return;
     }
@@ -168,9 +332,9 @@ static void cast(Type *from, Type *to) {
             return;
         
         if (to->kind == TY_DOUBLE)
-            printf("  cvtss2sd %s, %s\n", fr, fr); // Convert scalar single-precision floating-point values to scalar double-precision floating-point values.
+            emit("  cvtss2sd %s, %s\n", fr, fr); // Convert scalar single-precision floating-point values to scalar double-precision floating-point values.
         else
-            printf("  cvttss2si %s, %s\n", r, fr); // Convert with truncation a scalar single-precision floating-point value to a scalar double-word integer.
+            emit("  cvttss2si %s, %s\n", r, fr); // Convert with truncation a scalar single-precision floating-point value to a scalar double-word integer.
         return;
     }
 
@@ -179,56 +343,56 @@ static void cast(Type *from, Type *to) {
             return;
 
         if (to->kind == TY_FLOAT)
-            printf("  cvtsd2ss %s, %s\n", fr, fr); // Convert scalar double-precision floating-point values to scalar single-precision floating-point values.
+            emit("  cvtsd2ss %s, %s\n", fr, fr); // Convert scalar double-precision floating-point values to scalar single-precision floating-point values.
         else
-            printf("  cvttsd2si %s, %s\n", r, fr); // Convert with truncation scalar double-precision floating-point values to scalar doubleword integers.
+            emit("  cvttsd2si %s, %s\n", r, fr); // Convert with truncation scalar double-precision floating-point values to scalar doubleword integers.
         return;
     }
     
     if (to->kind == TY_FLOAT) {
-        printf("  cvtsi2ss %s, %s\n", fr, r); // Convert (scalar) Doubleword Integer to Scalar Single-Precision Floating-Point Value
+        emit("  cvtsi2ss %s, %s\n", fr, r); // Convert (scalar) Doubleword Integer to Scalar Single-Precision Floating-Point Value
         return;
     }
 
     if (to->kind == TY_DOUBLE) {
-        printf("  cvtsi2sd %s, %s\n", fr, r); // Convert (scalar) Doubleword Integer to Scalar Double-Precision Floating-Point Value
+        emit("  cvtsi2sd %s, %s\n", fr, r); // Convert (scalar) Doubleword Integer to Scalar Double-Precision Floating-Point Value
         return;
     }
 
     char *insn = to->is_unsigned ? "movzx" : "movsx";
 
     if (size_of(to) == 1)
-        printf("  %s %s, %sb\n", insn, r, r);
+        emit("  %s %s, %s\n", insn, r, sized_reg(top - 1, 1));
     else if (size_of(to) == 2)
-        printf("  %s %s, %sw\n", insn, r, r);
+        emit("  %s %s, %s\n", insn, r, sized_reg(top - 1, 2));
     else if (size_of(to) == 4)
-        printf("  mov %sd, %sd\n", r, r);
+        emit("  mov %s, %s\n", sized_reg(top - 1, 4), sized_reg(top - 1, 4));
     else if (is_integer(from) && size_of(from) < 8 && !from->is_unsigned)
-        printf("  movsx %s, %sd\n", r, r);
+        emit("  movsx %s, %s\n", r, sized_reg(top - 1, 4));
 
 }
 
 static void divmod(Node *node, char *rd, char *rs, char *r64, char *r32) {
     if (size_of(node->ty) == 8) {
-        printf("  mov rax, %s\n", rd);
+        emit("  mov rax, %s\n", rd);
         if (node->ty->is_unsigned) {
-            printf("  mov rdx, 0\n");
-            printf("  div %s\n", rs);
+            emit("  mov rdx, 0\n");
+            emit("  div %s\n", rs);
         } else {
-            printf("  cqo\n");
-            printf("  idiv %s\n", rs);
+            emit("  cqo\n");
+            emit("  idiv %s\n", rs);
         }
-        printf("  mov %s, %s\n", rd, r64);
+        emit("  mov %s, %s\n", rd, r64);
     } else {
-        printf("  mov eax, %s\n", rd);
+        emit("  mov eax, %s\n", rd);
         if (node->ty->is_unsigned) {
-            printf("  mov edx, 0\n");
-            printf("  div %s\n", rs);
+            emit("  mov edx, 0\n");
+            emit("  div %s\n", rs);
         } else {
-            printf("  cdq\n");
-            printf("  idiv %s\n", rs);
+            emit("  cdq\n");
+            emit("  idiv %s\n", rs);
         }
-        printf("  mov %s, %s\n", rd, r32);
+        emit("  mov %s, %s\n", rd, r32);
     }
 }
 
@@ -243,38 +407,63 @@ static void builtin_va_start(Node *node) {
             gp++;
     }
 
-    printf("  mov rax, [rbp-%d]\n", node->args[0]->offset);
-    printf("  mov dword ptr [rax], %d\n", gp * 8);
-    printf("  mov dword ptr [rax+4], %d\n", 48 + fp * 8);
-    printf("  mov [rax+16], rbp\n");
-    printf("  sub qword ptr [rax+16], 128\n");
+    emit("  mov rax, [rbp-%d]\n", node->args[0]->offset);
+    emit("  mov dword ptr [rax], %d\n", gp * 8);
+    emit("  mov dword ptr [rax+4], %d\n", 48 + fp * 16);
+    emit("  mov [rax+8], rbp\n");
+    emit("  add qword ptr [rax+8], 16\n");
+    emit("  mov [rax+16], rbp\n");
+    emit("  sub qword ptr [rax+16], 216\n");
     top++;
 }
 
+// Location of the last .loc directive
+static int loc_file_no;
+static int loc_line_no;
+
+// Emits a .loc directive for a given token unless the previous one
+// already covers the same line.
+static void emit_loc(Token *tok) {
+    if (!opt_g)
+        return;
+
+    int file_no = get_source_file(tok)->file_no;
+    if (file_no == loc_file_no && tok->line_no == loc_line_no)
+        return;
+
+    loc_file_no = file_no;
+    loc_line_no = tok->line_no;
+    emit(".loc %d %d\n", file_no, tok->line_no);
+}
+
 // Generate code for a given node.
 static void gen_expr(Node *node) {
-    printf(".loc %d %d\n", node->tok->file_no, node->tok->line_no);
+    emit_loc(node->tok);
 
     switch (node->kind) {
     case ND_NUM:
         if (node->ty->kind == TY_FLOAT) {
             float val = node->fval;
-            printf("  mov rax, %u\n", *(int *)&val); // get 32bit bit pattern of fval
-            printf("  push rax\n");                  // but using union is more better?
-            printf("  movss %s, [rsp]\n", freg(top++));
-            printf("  add rsp, 8\n");
+            emit("  mov rax, %u\n", *(int *)&val); // get 32bit bit pattern of fval
+            emit("  push rax\n");                  // but using union is more better?
+            emit("  movss %s, [rsp]\n", freg(top++));
+            emit("  add rsp, 8\n");
         } else if (node->ty->kind == TY_DOUBLE) {
-            printf("  movabs rax, %lu\n", *(long *)&node->fval); // get 64bit bit pattern of fval
-            printf("  push rax\n");
-            printf("  movsd %s, [rsp]\n", freg(top++));
-            printf("  add rsp, 8\n");
+            emit("  movabs rax, %lu\n", *(long *)&node->fval); // get 64bit bit pattern of fval
+            emit("  push rax\n");
+            emit("  movsd %s, [rsp]\n", freg(top++));
+            emit("  add rsp, 8\n");
         } else if (node->ty->kind == TY_LONG) {
-            printf("  movabs %s, %lu\n", reg(top++), node->val);
+            emit("  movabs %s, %lu\n", reg(top++), node->val);
         } else {
-            printf("  mov %s, %lu\n", reg(top++), node->val);
+            emit("  mov %s, %lu\n", reg(top++), node->val);
         }
         return;
     case ND_VAR:
+        if (node->var->reg) {
+            load_var_reg(node->var);
+            return;
+        }
         gen_addr(node);
         load(node->ty);
         return;
@@ -284,11 +473,11 @@ static void gen_expr(Node *node) {
 
         Member *mem = node->member;
         if (mem->is_bitfield) {
-            printf("  shl %s, %d\n", reg(top - 1), 64 - mem->bit_width - mem->bit_offset); // delete the upper bits over the member.
+            emit("  shl %s, %d\n", reg(top - 1), 64 - mem->bit_width - mem->bit_offset); // delete the upper bits over the member.
             if (mem->ty->is_unsigned)
-                printf("  shr %s, %d\n", reg(top - 1), 64 - mem->bit_width); // delete the lower bits under the member.
+                emit("  shr %s, %d\n", reg(top - 1), 64 - mem->bit_width); // delete the lower bits under the member.
             else
-                printf("  sar %s, %d\n", reg(top - 1), 64 - mem->bit_width); // delete the lower bits under the member.
+                emit("  sar %s, %d\n", reg(top - 1), 64 - mem->bit_width); // delete the lower bits under the member.
         } // reg(top - 1) has value of the member.
         return;
     }
@@ -305,6 +494,12 @@ static void gen_expr(Node *node) {
         if (node->lhs->ty->is_const && !node->is_init)
             error_tok(node->tok, "cannot assign to a const variable");
 
+        if (node->lhs->kind == ND_VAR && node->lhs->var->reg) {
+            gen_expr(node->rhs);
+            store_var_reg(node->lhs->var);
+            return;
+        }
+
         gen_expr(node->rhs);
         gen_addr(node->lhs);
 
@@ -312,17 +507,17 @@ static void gen_expr(Node *node) {
             // If the lhs is a bitfield, we need to read a value from memory
             // and merge it with a new value.
             Member *mem = node->lhs->member;
-            printf("  mov %s, %s\n", reg(top), reg(top - 1)); // reg(top - 1) is address of the member
+            emit("  mov %s, %s\n", reg(top), reg(top - 1)); // reg(top - 1) is address of the member
             top++;
             load(mem->ty); // load a member's value that contains the other member's value.
 
-            printf("  and %s, %ld\n", reg(top - 3), (1L << mem->bit_width) - 1); // Trim only the lower bits by the member's bit_width from the new value.
-            printf("  shl %s, %d\n", reg(top - 3), mem->bit_offset); // shift new value to correct bit position for the member.
+            emit("  and %s, %ld\n", reg(top - 3), (1L << mem->bit_width) - 1); // Trim only the lower bits by the member's bit_width from the new value.
+            emit("  shl %s, %d\n", reg(top - 3), mem->bit_offset); // shift new value to correct bit position for the member.
             // Now, reg(top - 3) has shifted new value that match the member bitfield.
             long mask = ((1L << mem->bit_width) - 1) << mem->bit_offset;
-            printf("  movabs rax, %ld\n", ~mask);
-            printf("  and %s, rax\n", reg(top - 1)); // delete the old value of the member only. Other member's values remain in the register.
-            printf("  or %s, %s\n", reg(top - 3), reg(top - 1)); // merge new value and other member's values. Now, reg(top-3) has merged value.
+            emit("  movabs rax, %ld\n", ~mask);
+            emit("  and %s, rax\n", reg(top - 1)); // delete the old value of the member only. Other member's values remain in the register.
+            emit("  or %s, %s\n", reg(top - 3), reg(top - 1)); // merge new value and other member's values. Now, reg(top-3) has merged value.
             top--;
         }
 
@@ -349,54 +544,54 @@ static void gen_expr(Node *node) {
         int seq = labelseq++;
         gen_expr(node->cond);
         cmp_zero(node->cond->ty);
-        printf("  je  .L.else.%d\n", seq);
+        emit("  je  .L.else.%d\n", seq);
         gen_expr(node->then);
         top--;
-        printf("  jmp .L.end.%d\n", seq);
-        printf(".L.else.%d:\n", seq);
+        emit("  jmp .L.end.%d\n", seq);
+        emit(".L.else.%d:\n", seq);
         gen_expr(node->els);
-        printf(".L.end.%d:\n", seq);
+        emit(".L.end.%d:\n", seq);
         return;
     }
     case ND_NOT:
         gen_expr(node->lhs);
         cmp_zero(node->lhs->ty);
-        printf("  sete %sb\n", reg(top));
-        printf("  movzx %s, %sb\n", reg(top), reg(top));
+        emit("  sete %s\n", sized_reg(top, 1));
+        emit("  movzx %s, %s\n", reg(top), sized_reg(top, 1));
         top++;
         return;
     case ND_BITNOT:
         gen_expr(node->lhs);
-        printf("  not %s\n", reg(top - 1));
+        emit("  not %s\n", reg(top - 1));
         return;
     case ND_LOGAND: {
         int seq = labelseq++;
         gen_expr(node->lhs);
         cmp_zero(node->lhs->ty);
-        printf("  je  .L.false.%d\n", seq);
+        emit("  je  .L.false.%d\n", seq);
         gen_expr(node->rhs);
         cmp_zero(node->rhs->ty);
-        printf("  je  .L.false.%d\n", seq);
-        printf("  mov %s, 1\n", reg(top));
-        printf("  jmp .L.end.%d\n", seq);
-        printf(".L.false.%d:\n", seq);
-        printf("  mov %s, 0\n", reg(top++));
-        printf(".L.end.%d:\n", seq);
+        emit("  je  .L.false.%d\n", seq);
+        emit("  mov %s, 1\n", reg(top));
+        emit("  jmp .L.end.%d\n", seq);
+        emit(".L.false.%d:\n", seq);
+        emit("  mov %s, 0\n", reg(top++));
+        emit(".L.end.%d:\n", seq);
         return;
     }
     case ND_LOGOR: {
         int seq = labelseq++;
         gen_expr(node->lhs);
         cmp_zero(node->lhs->ty);
-        printf("  jne .L.true.%d\n", seq);
+        emit("  jne .L.true.%d\n", seq);
         gen_expr(node->rhs);
         cmp_zero(node->rhs->ty);
-        printf("  jne .L.true.%d\n", seq);
-        printf("  mov %s, 0\n", reg(top));
-        printf("  jmp .L.end.%d\n", seq);
-        printf(".L.true.%d:\n", seq);
-        printf("  mov %s, 1\n", reg(top++));
-        printf(".L.end.%d:\n", seq);
+        emit("  jne .L.true.%d\n", seq);
+        emit("  mov %s, 0\n", reg(top));
+        emit("  jmp .L.end.%d\n", seq);
+        emit(".L.true.%d:\n", seq);
+        emit("  mov %s, 1\n", reg(top++));
+        emit(".L.end.%d:\n", seq);
         return;
     }
     case ND_FUNCALL: {
@@ -406,19 +601,28 @@ static void gen_expr(Node *node) {
             return;
         }
 
-        // Save caller-saved registers
-        printf("  sub rsp, 64\n");
-        printf("  mov [rsp], r10\n");
-        printf("  mov [rsp+8], r11\n");
-        printf("  movsd [rsp+16], xmm8\n");
-        printf("  movsd [rsp+24], xmm9\n");
-        printf("  movsd [rsp+32], xmm10\n");
-        printf("  movsd [rsp+40], xmm11\n");
-        printf("  movsd [rsp+48], xmm12\n");
-        printf("  movsd [rsp+56], xmm13\n");
+        // Save the live part of the stack and the variables in XMM
+        // registers, which the callee may clobber.
+        int nsaved = top;
+        int save_size = align_to(nsaved * 16 + current_fn->fp_regs * 8, 16);
+        if (save_size)
+            emit("  sub rsp, %d\n", save_size);
+        for (int i = 0; i < nsaved; i++) {
+            emit("  mov [rsp+%d], %s\n", i * 16, reg(i));
+            emit("  movsd [rsp+%d], %s\n", i * 16 + 8, freg(i));
+        }
+        for (int i = 0; i < current_fn->fp_regs; i++)
+            emit("  movsd [rsp+%d], %s\n", nsaved * 16 + i * 8, var_xreg[i]);
 
         gen_expr(node->lhs); // Load the fanction name to the register-machine
 
+        // Move the function address out of the way of the arguments.
+        char *fn_reg = reg(--top);
+        if (top >= 2) {
+            emit("  mov r11, %s\n", fn_reg);
+            fn_reg = "r11";
+        }
+
         // Load arguments from the stack.
         int gp = 0, fp = 0;
         for (int i = 0; i < node->nargs; i++) {
@@ -427,50 +631,54 @@ static void gen_expr(Node *node) {
             int sz = size_of(arg->ty);
 
             if (is_flonum(arg->ty)) {
+                if (fp == 8)
+                    error_tok(node->tok, "arguments passed on the stack are not supported");
                 if (arg->ty->kind == TY_FLOAT)
-                    printf("  movss xmm%d, [rbp-%d]\n", fp++, arg->offset);
+                    emit("  movss xmm%d, [rbp-%d]\n", fp++, arg->offset);
                 else
-                    printf("  movsd xmm%d, [rbp-%d]\n", fp++, arg->offset);
+                    emit("  movsd xmm%d, [rbp-%d]\n", fp++, arg->offset);
+                continue;
             }
-            
+
+            if (gp == 6)
+                error_tok(node->tok, "arguments passed on the stack are not supported");
             if (sz == 1)
-                printf("  %s %s, byte ptr [rbp-%d]\n", insn, argreg32[i], arg->offset);
+                emit("  %s %s, byte ptr [rbp-%d]\n", insn, argreg32[gp++], arg->offset);
             else if (sz == 2)
-                printf("  %s %s, word ptr [rbp-%d]\n", insn, argreg32[i], arg->offset);
+                emit("  %s %s, word ptr [rbp-%d]\n", insn, argreg32[gp++], arg->offset);
             else if (sz == 4)
-                printf("  mov %s, dword ptr [rbp-%d]\n", argreg32[i], arg->offset);
+                emit("  mov %s, dword ptr [rbp-%d]\n", argreg32[gp++], arg->offset);
             else
-                printf("  mov %s, [rbp-%d]\n", argreg64[i], arg->offset);
+                emit("  mov %s, [rbp-%d]\n", argreg64[gp++], arg->offset);
         }
 
         // Call a function
-        printf("  mov rax, %d\n", fp);
-        printf("  call %s\n", reg(--top));
+        emit("  mov rax, %d\n", fp);
+        emit("  call %s\n", fn_reg);
 
         // The System V x86-64 ABI has a special rule regarding a boolean
         // return value that only the lower 8 bits are valid for it and
         // the upper 56 bits may contain garbage. Here, we clear the upper
         // 56 bits.
         if (node->ty->kind == TY_BOOL)
-            printf("  movzx eax, al\n");
-
-        // Restore caller-saved registers
-        printf("  mov r10, [rsp]\n");
-        printf("  mov r11, [rsp+8]\n");
-        printf("  movsd xmm8, [rsp+16]\n");
-        printf("  movsd xmm9, [rsp+24]\n");
-        printf("  movsd xmm10, [rsp+32]\n");
-        printf("  movsd xmm11, [rsp+40]\n");
-        printf("  movsd xmm12, [rsp+48]\n");
-        printf("  movsd xmm13, [rsp+56]\n");
-        printf("  add rsp, 64\n");
+            emit("  movzx eax, al\n");
+
+        // Restore the saved registers
+        for (int i = 0; i < nsaved; i++) {
+            emit("  mov %s, [rsp+%d]\n", reg(i), i * 16);
+            emit("  movsd %s, [rsp+%d]\n", freg(i), i * 16 + 8);
+        }
+        for (int i = 0; i < current_fn->fp_regs; i++)
+            emit("  movsd %s, [rsp+%d]\n", var_xreg[i], nsaved * 16 + i * 8);
+        if (save_size)
+            emit("  add rsp, %d\n", save_size);
         // Store the return value
         if (node->ty->kind == TY_FLOAT)
-            printf("  movss %s, xmm0\n", freg(top++));
+            emit("  movss %s, xmm0\n", freg(top++));
         else if (node->ty->kind == TY_DOUBLE)
-            printf("  movsd %s, xmm0\n", freg(top++));
+            emit("  movsd %s, xmm0\n", freg(top++));
         else
-            printf("  mov %s, rax\n", reg(top++));
+            emit("  mov %s, rax\n", reg(top++));
         return;
     } // ND_FANCALL
     } // switch
@@ -488,33 +696,33 @@ static void gen_expr(Node *node) {
     switch (node->kind) {
     case ND_ADD:
         if (node->ty->kind == TY_FLOAT)
-            printf("  addss %s, %s\n", fd, fs);
+            emit("  addss %s, %s\n", fd, fs);
         else if (node->ty->kind == TY_DOUBLE)
-            printf("  addsd %s, %s\n", fd, fs);
+            emit("  addsd %s, %s\n", fd, fs);
         else
-            printf("  add %s, %s\n", rd, rs);
+            emit("  add %s, %s\n", rd, rs);
         return;
     case ND_SUB:
         if (node->ty->kind == TY_FLOAT)
-            printf("  subss %s, %s\n", fd, fs);
+            emit("  subss %s, %s\n", fd, fs);
         else if (node->ty->kind == TY_DOUBLE)
-            printf("  subsd %s, %s\n", fd, fs);
+            emit("  subsd %s, %s\n", fd, fs);
         else
-            printf("  sub %s, %s\n", rd, rs);
+            emit("  sub %s, %s\n", rd, rs);
         return;
     case ND_MUL:
         if (node->ty->kind == TY_FLOAT)
-            printf("  mulss %s, %s\n", fd, fs);
+            emit("  mulss %s, %s\n", fd, fs);
         else if (node->ty->kind == TY_DOUBLE)
-            printf("  mulsd %s, %s\n", fd, fs);
+            emit("  mulsd %s, %s\n", fd, fs);
         else
-            printf("  imul %s, %s\n", rd, rs);
+            emit("  imul %s, %s\n", rd, rs);
         return;
     case ND_DIV:
         if (node->ty->kind == TY_FLOAT)
-            printf("  divss %s, %s\n", fd, fs);
+            emit("  divss %s, %s\n", fd, fs);
         else if (node->ty->kind == TY_DOUBLE)
-            printf("  divsd %s, %s\n", fd, fs);
+            emit("  divsd %s, %s\n", fd, fs);
         else
             divmod(node, rd, rs, "rax", "eax");
         return;
@@ -522,76 +730,76 @@ static void gen_expr(Node *node) {
         divmod(node, rd, rs, "rdx", "edx");
         return;
     case ND_BITAND:
-        printf("  and %s, %s\n", rd, rs); // and op1, op2 => op1 = op1 & op2
+        emit("  and %s, %s\n", rd, rs); // and op1, op2 => op1 = op1 & op2
         return;
     case ND_BITOR:
-        printf("  or %s, %s\n", rd, rs);
+        emit("  or %s, %s\n", rd, rs);
         return;
     case ND_BITXOR:
-        printf("  xor %s, %s\n", rd, rs);
+        emit("  xor %s, %s\n", rd, rs);
         return;
     case ND_EQ:
         if (node->lhs->ty->kind == TY_FLOAT)
-            printf("  ucomiss %s, %s\n", fd, fs);
+            emit("  ucomiss %s, %s\n", fd, fs);
         else if (node->lhs->ty->kind == TY_DOUBLE)
-            printf("  ucomisd %s, %s\n", fd, fs);
+            emit("  ucomisd %s, %s\n", fd, fs);
         else
-            printf("  cmp %s, %s\n", rd, rs);
-        printf("  sete al\n");
-        printf("  movzx %s, al\n", rd);
+            emit("  cmp %s, %s\n", rd, rs);
+        emit("  sete al\n");
+        emit("  movzx %s, al\n", rd);
         return;
     case ND_NE:
         if (node->lhs->ty->kind == TY_FLOAT)
-            printf("  ucomiss %s, %s\n", fd, fs);
+            emit("  ucomiss %s, %s\n", fd, fs);
         else if (node->lhs->ty->kind == TY_DOUBLE)
-            printf("  ucomisd %s, %s\n", fd, fs);
+            emit("  ucomisd %s, %s\n", fd, fs);
         else
-            printf("  cmp %s, %s\n", rd, rs);
-        printf("  setne al\n");
-        printf("  movzx %s, al\n", rd);
+            emit("  cmp %s, %s\n", rd, rs);
+        emit("  setne al\n");
+        emit("  movzx %s, al\n", rd);
         return;
     case ND_LT:
         if (node->lhs->ty->kind == TY_FLOAT) {
-            printf("  ucomiss %s, %s\n", fd, fs);
-            printf("  setb al\n");
+            emit("  ucomiss %s, %s\n", fd, fs);
+            emit("  setb al\n");
         } else if (node->lhs->ty->kind == TY_DOUBLE) {
-            printf("  ucomisd %s, %s\n", fd, fs);
-            printf("  setb al\n");
+            emit("  ucomisd %s, %s\n", fd, fs);
+            emit("  setb al\n");
         } else {
-            printf("  cmp %s, %s\n", rd, rs);
+            emit("  cmp %s, %s\n", rd, rs);
             if (node->lhs->ty->is_unsigned)
-                printf("  setb al\n"); // Set byte if below.
+                emit("  setb al\n"); // Set byte if below.
             else
-                printf("  setl al\n"); // Set byte if less.
+                emit("  setl al\n"); // Set byte if less.
         }
-        printf("  movzx %s, al\n", rd);
+        emit("  movzx %s, al\n", rd);
         return;
     case ND_LE:
         if (node->lhs->ty->kind == TY_FLOAT) {
-            printf("  ucomiss %s, %s\n", fd, fs);
-            printf("  setbe al\n");
+            emit("  ucomiss %s, %s\n", fd, fs);
+            emit("  setbe al\n");
         } else if (node->lhs->ty->kind == TY_DOUBLE) {
-            printf("  ucomisd %s, %s\n", fd, fs);
-            printf("  setbe al\n");
+            emit("  ucomisd %s, %s\n", fd, fs);
+            emit("  setbe al\n");
         } else {
-            printf("  cmp %s, %s\n", rd, rs);
+            emit("  cmp %s, %s\n", rd, rs);
             if (node->lhs->ty->is_unsigned)
-                printf("  setbe al\n"); // Set byte if below or equal.
+                emit("  setbe al\n"); // Set byte if below or equal.
             else
-                printf("  setle al\n");
+                emit("  setle al\n");
         }
-        printf("  movzx %s, al\n", rd);
+        emit("  movzx %s, al\n", rd);
         return;
     case ND_SHL:
-        printf("  mov rcx, %s\n", reg(top));
-        printf("  shl %s, cl\n", rd);
+        emit("  mov rcx, %s\n", reg(top));
+        emit("  shl %s, cl\n", rd);
         return;
     case ND_SHR:
-        printf("  mov rcx, %s\n", reg(top));
+        emit("  mov rcx, %s\n", reg(top));
         if (node->lhs->ty->is_unsigned)
-            printf("  shr %s, cl\n", rd);
+            emit("  shr %s, cl\n", rd);
         else
-            printf("  sar %s, cl\n", rd);
+            emit("  sar %s, cl\n", rd);
         return;
     default:
         error_tok(node->tok, "invalid expression");
@@ -599,7 +807,7 @@ static void gen_expr(Node *node) {
 }
 
 static void gen_stmt(Node *node) {
-    printf(".loc %d %d\n", node->tok->file_no, node->tok->line_no);
+    emit_loc(node->tok);
 
     switch (node->kind) {
     case ND_IF: {
@@ -607,18 +815,18 @@ static void gen_stmt(Node *node) {
         if (node->els) {
             gen_expr(node->cond);
             cmp_zero(node->cond->ty);
-            printf("  je  .L.else.%d\n", seq);
+            emit("  je  .L.else.%d\n", seq);
             gen_stmt(node->then);
-            printf("  jmp .L.end.%d\n", seq);
-            printf(".L.else.%d:\n", seq);
+            emit("  jmp .L.end.%d\n", seq);
+            emit(".L.else.%d:\n", seq);
             gen_stmt(node->els);
-            printf(".L.end.%d:\n", seq);
+            emit(".L.end.%d:\n", seq);
         } else {
             gen_expr(node->cond);
             cmp_zero(node->cond->ty);
-            printf("  je  .L.end.%d\n", seq);
+            emit("  je  .L.end.%d\n", seq);
             gen_stmt(node->then);
-            printf(".L.end.%d:\n", seq);
+            emit(".L.end.%d:\n", seq);
         }
         return;
     }
@@ -630,18 +838,18 @@ static void gen_stmt(Node *node) {
 
         if (node->init)
             gen_stmt(node->init);
-        printf(".L.begin.%d:\n", seq);
+        emit(".L.begin.%d:\n", seq);
         if (node->cond) {
             gen_expr(node->cond);
             cmp_zero(node->cond->ty);
-            printf("  je  .L.break.%d\n", seq);
+            emit("  je  .L.break.%d\n", seq);
         }
         gen_stmt(node->then);
-        printf(".L.continue.%d:\n", seq);
+        emit(".L.continue.%d:\n", seq);
         if (node->inc)
             gen_stmt(node->inc);
-        printf("  jmp .L.begin.%d\n", seq);
-        printf(".L.break.%d:\n", seq);
+        emit("  jmp .L.begin.%d\n", seq);
+        emit(".L.break.%d:\n", seq);
 
         brkseq = brk;
         contseq = cont;
@@ -653,13 +861,13 @@ static void gen_stmt(Node *node) {
         int cont = contseq;
         brkseq = contseq = seq;
 
-        printf(".L.begin.%d:\n", seq);
+        emit(".L.begin.%d:\n", seq);
         gen_stmt(node->then);
-        printf(".L.continue.%d:\n", seq);
+        emit(".L.continue.%d:\n", seq);
         gen_expr(node->cond);
         cmp_zero(node->cond->ty);
-        printf("  jne .L.begin.%d\n", seq);
-        printf(".L.break.%d:\n", seq);
+        emit("  jne .L.begin.%d\n", seq);
+        emit(".L.break.%d:\n", seq);
 
         brkseq = brk;
         contseq = cont;
@@ -676,8 +884,8 @@ static void gen_stmt(Node *node) {
         for (Node *n = node->case_next; n; n = n->case_next) {
             n->case_label = labelseq++;
             // n->case_end_label = seq; // is not used
-            printf("  cmp %s, %ld\n", reg(top - 1), n->val);
-            printf("  je .L.case.%d\n", n->case_label);
+            emit("  cmp %s, %ld\n", reg(top - 1), n->val);
+            emit("  je .L.case.%d\n", n->case_label);
         }
         top--;
 
@@ -685,18 +893,18 @@ static void gen_stmt(Node *node) {
             int i = labelseq++;
             // node->default_case->case_end_label = seq; // is not used.
             node->default_case->case_label = i;
-            printf("  jmp .L.case.%d\n", i);
+            emit("  jmp .L.case.%d\n", i);
         }
 
-        printf("  jmp .L.break.%d\n", seq);
+        emit("  jmp .L.break.%d\n", seq);
         gen_stmt(node->then);
-        printf(".L.break.%d:\n", seq);
+        emit(".L.break.%d:\n", seq);
 
         brkseq = brk;
         return;
     }
     case ND_CASE:
-        printf(".L.case.%d:\n", node->case_label);
+        emit(".L.case.%d:\n", node->case_label);
         gen_stmt(node->lhs);
         return;
     case ND_BLOCK:
@@ -706,29 +914,29 @@ static void gen_stmt(Node *node) {
     case ND_BREAK:
         if (brkseq == 0)
             error_tok(node->tok, "stray break");
-        printf("  jmp .L.break.%d\n", brkseq);
+        emit("  jmp .L.break.%d\n", brkseq);
         return;
     case ND_CONTINUE:
         if (contseq == 0)
             error_tok(node->tok, "stray continue");
-        printf("  jmp .L.continue.%d\n", contseq);
+        emit("  jmp .L.continue.%d\n", contseq);
         return;
     case ND_GOTO:
-        printf("  jmp .L.label.%s.%s\n", current_fn->name, node->label_name);
+        emit("  jmp .L.label.%s.%s\n", current_fn->name, node->label_name);
         return;
     case ND_LABEL:
-        printf(".L.label.%s.%s:\n", current_fn->name, node->label_name);
+        emit(".L.label.%s.%s:\n", current_fn->name, node->label_name);
         gen_stmt(node->lhs);
         return;
     case ND_RETURN:
         if (node->lhs) {
             gen_expr(node->lhs);
             if (is_flonum(node->lhs->ty))
-                printf("  movsd xmm0, %s\n", freg(--top));
+                emit("  movsd xmm0, %s\n", freg(--top));
             else
-                printf("  mov rax, %s\n", reg(--top));
+                emit("  mov rax, %s\n", reg(--top));
         }
-        printf("  jmp .L.return.%s\n", current_fn->name);
+        emit("  jmp .L.return.%s\n", current_fn->name);
         return;
     case ND_EXPR_STMT:
         gen_expr(node->lhs);
@@ -740,41 +948,43 @@ static void gen_stmt(Node *node) {
 }
 
 static void emit_bss(Program *prog) {
-    printf(".bss\n");
+    emit(".bss\n");
 
     for (Var *var = prog->globals; var; var = var->next) {
         if (var->init_data)
             continue;
         
-        printf(".align %d\n", var->align);
+        emit(".align %d\n", var->align);
         if (!var->is_static)
-            printf(".globl %s\n", var->name);
-        printf("%s:\n", var->name);
-        printf("  .zero %d\n", size_of(var->ty));
+            emit(".globl %s\n", var->name);
+        emit("%s:\n", var->name);
+        emit("  .zero %d\n", size_of(var->ty));
     }
 }
 
 static void emit_data(Program *prog) {
-    printf(".data\n");
+    emit(".data\n");
 
     for (Var *var = prog->globals; var; var = var->next) {
         if (!var->init_data)
             continue;
             
-        printf(".align %d\n", var->align);
+        emit(".align %d\n", var->align);
         if (!var->is_static)
-            printf(".globl %s\n", var->name);
-        printf("%s:\n", var->name);
+            emit(".globl %s\n", var->name);
+        emit("%s:\n", var->name);
 
         Relocation *rel = var->rel;
         int pos = 0;
         while (pos < size_of(var->ty)) {
             if (rel && rel->offset == pos) {
-                printf("  .quad %s%+ld\n", rel->label, rel->addend);
+                emit("  .quad %s%+ld\n", rel->label, rel->addend);
                 rel = rel->next;
                 pos += 8;
             } else {
-                printf("  .byte %d\n", var->init_data[pos++]);
+                emit_str("  .byte ");
+                emit_long(var->init_data[pos++]);
+                emit_char('\n');
             }
         }
     }
@@ -791,38 +1001,56 @@ static char *get_argreg(int sz, int idx) {
     return argreg64[idx];
 }
 
+// Loads a parameter from the stack frame to its register.
+static void load_param_reg(Var *var) {
+    Type *ty = var->ty;
+    int r = var->reg - 1;
+    int sz = size_of(ty);
+    char *insn = ty->is_unsigned ? "movzx" : "movsx";
+
+    if (ty->kind == TY_FLOAT)
+        emit("  movss %s, [rbp-%d]\n", var_xreg[r], var->offset);
+    else if (ty->kind == TY_DOUBLE)
+        emit("  movsd %s, [rbp-%d]\n", var_xreg[r], var->offset);
+    else if (sz == 1)
+        emit("  %s %s, byte ptr [rbp-%d]\n", insn, var_reg32[r], var->offset);
+    else if (sz == 2)
+        emit("  %s %s, word ptr [rbp-%d]\n", insn, var_reg32[r], var->offset);
+    else if (sz == 4)
+        emit("  mov %s, dword ptr [rbp-%d]\n", var_reg32[r], var->offset);
+    else
+        emit("  mov %s, [rbp-%d]\n", var_reg64[r], var->offset);
+}
+
 static void emit_text(Program *prog) {
-    printf(".text\n");
+    emit(".text\n");
 
     for (Function *fn = prog->fns; fn; fn = fn->next) {
+        timer_start("codegen function", fn->name);
         if (!fn->is_static)
-            printf(".globl %s\n", fn->name);
-        printf("%s:\n", fn->name);
+            emit(".globl %s\n", fn->name);
+        emit("%s:\n", fn->name);
         current_fn = fn;
 
-        // Prologue. r12-15 are callee-saved registers.
-        printf("  push rbp\n");
-        printf("  mov rbp, rsp\n");
-        printf("  sub rsp, %d\n", fn->stack_size);
-        printf("  mov [rbp-8], r12\n");
-        printf("  mov [rbp-16], r13\n");
-        printf("  mov [rbp-24], r14\n");
-        printf("  mov [rbp-32], r15\n");
+        // Prologue. Save the callee-saved registers used for variables.
+        emit("  push rbp\n");
+        emit("  mov rbp, rsp\n");
+        emit("  sub rsp, %d\n", fn->stack_size);
+        for (int i = 0; i < fn->gp_regs; i++)
+            emit("  mov [rbp-%d], %s\n", i * 8 + 8, var_reg64[i]);
 
-        // Save arg registers if function is variadic
+        // Save arg registers if function is variadic. The layout is
+        // the register save area of the ABI: six GP registers followed
+        // by eight XMM registers in 16-byte slots.
         if (fn->is_variadic) {
-            printf("  mov [rbp-128], rdi\n");
-            printf("  mov [rbp-120], rsi\n");
-            printf("  mov [rbp-112], rdx\n");
-            printf("  mov [rbp-104], rcx\n");
-            printf("  mov [rbp-96], r8\n");
-            printf("  mov [rbp-88], r9\n");
-            printf("  movsd [rbp-80], xmm0\n");
-            printf("  movsd [rbp-72], xmm1\n");
-            printf("  movsd [rbp-64], xmm2\n");
-            printf("  movsd [rbp-56], xmm3\n");
-            printf("  movsd [rbp-48], xmm4\n");
-            printf("  movsd [rbp-40], xmm5\n");
+            emit("  mov [rbp-216], rdi\n");
+            emit("  mov [rbp-208], rsi\n");
+            emit("  mov [rbp-200], rdx\n");
+            emit("  mov [rbp-192], rcx\n");
+            emit("  mov [rbp-184], r8\n");
+            emit("  mov [rbp-176], r9\n");
+            for (int i = 0; i < 8; i++)
+                emit("  movsd [rbp-%d], xmm%d\n", 168 - i * 16, i);
         }
         
         // Push arguments to the stack
@@ -833,18 +1061,27 @@ static void emit_text(Program *prog) {
             else
                 gp++;
         }
+        if (gp > 6 || fp > 8)
+            error("%s: parameters passed on the stack are not supported", fn->name);
 
         for (Var *var = fn->params; var; var = var->next) {
             if (var->ty->kind == TY_FLOAT) {
-                printf("  movss [rbp-%d], xmm%d\n", var->offset, --fp);
+                emit("  movss [rbp-%d], xmm%d\n", var->offset, --fp);
             } else if (var->ty->kind == TY_DOUBLE) {
-                printf("  movsd [rbp-%d], xmm%d\n", var->offset, --fp);
+                emit("  movsd [rbp-%d], xmm%d\n", var->offset, --fp);
             } else {
                 char *r = get_argreg(size_of(var->ty), --gp);
-                printf("  mov [rbp-%d], %s\n", var->offset, r);
+                emit("  mov [rbp-%d], %s\n", var->offset, r);
             }
         }
 
+        // Move parameters that live in registers there. They may be
+        // assigned to argument registers, so this is done only after
+        // all parameters have been stored.
+        for (Var *var = fn->params; var; var = var->next)
+            if (var->reg)
+                load_param_reg(var);
+
         // Emit code
         for (Node *n = fn->node; n; n = n->next) {
             gen_stmt(n);
@@ -852,20 +1089,26 @@ static void emit_text(Program *prog) {
         }
 
         // Epilogue
-        printf(".L.return.%s:\n", fn->name);
-        printf("  mov r12, [rbp-8]\n");
-        printf("  mov r13, [rbp-16]\n");
-        printf("  mov r14, [rbp-24]\n");
-        printf("  mov r15, [rbp-32]\n");
-        printf("  mov rsp, rbp\n");
-        printf("  pop rbp\n");
-        printf("  ret\n");
+        emit(".L.return.%s:\n", fn->name);
+        for (int i = 0; i < fn->gp_regs; i++)
+            emit("  mov %s, [rbp-%d]\n", var_reg64[i], i * 8 + 8);
+        emit("  mov rsp, rbp\n");
+        emit("  pop rbp\n");
+        emit("  ret\n");
+        timer_stop();
     }
 }
 
 void codegen(Program *prog) {
-    printf(".intel_syntax noprefix\n");
+    labelseq = 1;
+    loc_file_no = loc_line_no = 0;
+
+    // .file directives have been written through stdio.
+    fflush(stdout);
+
+    emit(".intel_syntax noprefix\n");
     emit_bss(prog);
     emit_data(prog);
     emit_text(prog);
+    flush_output();
 }
@@ -0,0 +1,164 @@
+// This is an implementation of the open-addressing hash table.
+//
+// Keys are (pointer, length) pairs, so callers can look up a name
+// directly from a token without making a NUL-terminated copy of it.
+// Deleted entries are replaced with a tombstone so that probe
+// sequences that went through them are not cut short.
+
+#include "zcc.h"
+
+// Initial hash bucket size
+#define INIT_SIZE 16
+
+// Rehash if the usage exceeds 70%.
+#define HIGH_WATERMARK 70
+
+// We'll keep the usage below 50% after rehashing.
+#define LOW_WATERMARK 50
+
+// Represents a deleted hash entry
+#define TOMBSTONE ((void *)-1)
+
+// 32-bit FNV-1a hash. Tokens carry this value for their identifier
+// names, so the function must stay in sync with the tokenizer.
+unsigned int fnv_hash(char *s, int len) {
+    unsigned int hash = 2166136261;
+    for (int i = 0; i < len; i++) {
+        hash ^= (unsigned char)s[i];
+        hash *= 16777619;
+    }
+    return hash;
+}
+
+// Make room for new entires in a given hashmap by removing
+// tombstones and possibly extending the bucket size.
+static void rehash(HashMap *map) {
+    // Compute the size of the new hashmap.
+    int nkeys = 0;
+    for (int i = 0; i < map->capacity; i++)
+        if (map->buckets[i].key && map->buckets[i].key != TOMBSTONE)
+            nkeys++;
+
+    int cap = map->capacity;
+    while ((nkeys * 100) / cap >= LOW_WATERMARK)
+        cap = cap * 2;
+    assert(cap > 0);
+
+    // Create a new hashmap and copy all key-values.
+    HashMap map2 = {};
+    map2.buckets = calloc(cap, sizeof(HashEntry));
+    map2.capacity = cap;
+
+    for (int i = 0; i < map->capacity; i++) {
+        HashEntry *ent = &map->buckets[i];
+        if (ent->key && ent->key != TOMBSTONE)
+            hashmap_put2(&map2, ent->key, ent->keylen, ent->val);
+    }
+
+    assert(map2.used == nkeys);
+    free(map->buckets);
+    *map = map2;
+}
+
+static bool match(HashEntry *ent, char *key, int keylen) {
+    // Interned names are found by the pointer comparison alone.
+    if (ent->key == key)
+        return true;
+    return ent->key && ent->key != TOMBSTONE &&
+           ent->keylen == keylen && memcmp(ent->key, key, keylen) == 0;
+}
+
+static HashEntry *get_entry(HashMap *map, char *key, int keylen, unsigned int hash) {
+    if (!map->buckets)
+        return NULL;
+
+    for (int i = 0; i < map->capacity; i++) {
+        HashEntry *ent = &map->buckets[(hash + i) % map->capacity];
+        if (match(ent, key, keylen))
+            return ent;
+        if (ent->key == NULL)
+            return NULL;
+    }
+    error("internal error: hashmap is full");
+}
+
+static HashEntry *
+get_or_insert_entry(HashMap *map, char *key, int keylen, unsigned int hash) {
+    if (!map->buckets) {
+        map->buckets = calloc(INIT_SIZE, sizeof(HashEntry));
+        map->capacity = INIT_SIZE;
+    } else if ((map->used * 100) / map->capacity >= HIGH_WATERMARK) {
+        rehash(map);
+    }
+
+    // A tombstone can be reused, but only after we have made sure that
+    // the key doesn't appear later in the same probe sequence.
+    HashEntry *tomb = NULL;
+
+    for (int i = 0; i < map->capacity; i++) {
+        HashEntry *ent = &map->buckets[(hash + i) % map->capacity];
+
+        if (match(ent, key, keylen))
+            return ent;
+
+        if (ent->key == TOMBSTONE) {
+            if (!tomb)
+                tomb = ent;
+            continue;
+        }
+
+        if (ent->key == NULL) {
+            if (!tomb) {
+                tomb = ent;
+                map->used++;
+            }
+            tomb->key = key;
+            tomb->keylen = keylen;
+            return tomb;
+        }
+    }
+
+    if (tomb) {
+        tomb->key = key;
+        tomb->keylen = keylen;
+        return tomb;
+    }
+    error("internal error: hashmap is full");
+}
+
+void *hashmap_get(HashMap *map, char *key) {
+    return hashmap_get2(map, key, strlen(key));
+}
+
+void *hashmap_get2(HashMap *map, char *key, int keylen) {
+    return hashmap_get3(map, key, keylen, fnv_hash(key, keylen));
+}
+
+// Same as hashmap_get2 but takes a precomputed fnv_hash() of the key.
+void *hashmap_get3(HashMap *map, char *key, int keylen, unsigned int hash) {
+    HashEntry *ent = get_entry(map, key, keylen, hash);
+    return ent ? ent->val : NULL;
+}
+
+void hashmap_put(HashMap *map, char *key, void *val) {
+    hashmap_put2(map, key, strlen(key), val);
+}
+
+void hashmap_put2(HashMap *map, char *key, int keylen, void *val) {
+    hashmap_put3(map, key, keylen, fnv_hash(key, keylen), val);
+}
+
+void hashmap_put3(HashMap *map, char *key, int keylen, unsigned int hash, void *val) {
+    HashEntry *ent = get_or_insert_entry(map, key, keylen, hash);
+    ent->val = val;
+}
+
+void hashmap_delete(HashMap *map, char *key) {
+    hashmap_delete2(map, key, strlen(key));
+}
+
+void hashmap_delete2(HashMap *map, char *key, int keylen) {
+    HashEntry *ent = get_entry(map, key, keylen, fnv_hash(key, keylen));
+    if (ent)
+        ent->key = TOMBSTONE;
+}
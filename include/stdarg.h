@@ -6,10 +6,41 @@ typedef struct {
   unsigned int fp_offset;
   void *overflow_arg_area;
   void *reg_save_area;
-} va_list[1];
+} __va_elem;
+
+typedef __va_elem va_list[1];
+
+// Returns the address of the next integer or pointer argument.
+static void *__va_arg_gp(__va_elem *ap) {
+  void *p;
+  if (ap->gp_offset < 48) {
+    p = (char *)ap->reg_save_area + ap->gp_offset;
+    ap->gp_offset += 8;
+  } else {
+    p = ap->overflow_arg_area;
+    ap->overflow_arg_area = (char *)p + 8;
+  }
+  return p;
+}
+
+// Returns the address of the next floating-point argument.
+static void *__va_arg_fp(__va_elem *ap) {
+  void *p;
+  if (ap->fp_offset < 176) {
+    p = (char *)ap->reg_save_area + ap->fp_offset;
+    ap->fp_offset += 16;
+  } else {
+    p = ap->overflow_arg_area;
+    ap->overflow_arg_area = (char *)p + 8;
+  }
+  return p;
+}
 
 #define va_start(ap, last) __builtin_va_start(ap)
+#define va_arg(ap, type) \
+  (*(type *)(__builtin_reg_class(type) ? __va_arg_fp(ap) : __va_arg_gp(ap)))
 #define va_end(ap) 0
+#define va_copy(dest, src) (*(dest) = *(src))
 
 #define __GNUC_VA_LIST 1
 typedef va_list __gnuc_va_list;
@@ -2,13 +2,33 @@
 
 bool opt_E;
 bool opt_fpic = true;
+bool opt_g = true;
+bool opt_arena_stats;
+bool opt_emit_pch;
 
 char **include_paths;
 
-static char *input_file;
+static char **input_files;
+static int ninput_files;
+static char *output_file;
+static char *pch_file;
+
+// -S or -c: compile each input to a file next to it.
+static bool opt_S;
+static bool opt_c;
+
+// Maximum number of translation units compiled in parallel
+static int opt_j = 1;
+
+// Use the built-in assembler for -c instead of running `as`.
+static bool opt_integrated_as = true;
 
 static void usage(void) {
-    fprintf(stderr, "zcc [ -I<path> ] [ -o <path> ]<file>\n");
+    fprintf(stderr, "zcc [ -I<path> ] [ -D<macro>[=<val>] ] [ -U<macro> ] [ -o <path> ]\n"
+                    "    [ -include-pch <path> ] [ --emit-pch ]\n"
+                    "    [ -fcache-dir=<dir> ] [ -fno-integrated-as ] [ -fno-regalloc ] [ -g0 ]\n"
+                    "    [ -ftime-report ] [ -ftime-trace[=<path>] ] [ -fmem-report ]\n"
+                    "    [ -S | -c ] [ -j <n> ] <file>...\n");
     exit(1);
 }
 
@@ -26,14 +46,16 @@ static void redirect_stdout(char *filename) {
 static void define(char *str) {
     char *eq = strchr(str, '=');
     if (eq)
-        define_macro(strndup(str, eq - str), eq + 1);
+        cmdline_define(strndup(str, eq - str), eq + 1);
     else
-        define_macro(str, "");
+        cmdline_define(str, "");
 }
 
 static void parse_args(int argc, char **argv) {
+    bool explicit_g = false;
     include_paths = malloc(sizeof(char *) * argc);
     int npaths = 0;
+    input_files = malloc(sizeof(char *) * argc);
 
     for (int i = 1; i < argc; i++) {
         if (!strcmp(argv[i], "--help"))
@@ -52,12 +74,34 @@ static void parse_args(int argc, char **argv) {
         if (!strcmp(argv[i], "-o")) { // e.g. "-o <path>"
             if (!argv[++i])
                 usage();
-            redirect_stdout(argv[i]);
+            output_file = argv[i];
             continue;
         }
 
         if (!strncmp(argv[i], "-o", 2)) { // e.g. "-o<path>"
-            redirect_stdout(argv[i] + 2);
+            output_file = argv[i] + 2;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "-S")) {
+            opt_S = true;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "-c")) {
+            opt_c = true;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "-j")) { // e.g. "-j 4"
+            if (!argv[++i])
+                usage();
+            opt_j = atoi(argv[i]);
+            continue;
+        }
+
+        if (!strncmp(argv[i], "-j", 2)) { // e.g. "-j4"
+            opt_j = atoi(argv[i] + 2);
             continue;
         }
 
@@ -73,6 +117,18 @@ static void parse_args(int argc, char **argv) {
             continue;
         }
 
+        if (!strcmp(argv[i], "-U")) {
+            if (!argv[++i])
+                usage();
+            cmdline_undef(argv[i]);
+            continue;
+        }
+
+        if (!strncmp(argv[i], "-U", 2)) {
+            cmdline_undef(argv[i] + 2);
+            continue;
+        }
+
         if (!strcmp(argv[i], "-fpic") || !strcmp(argv[i], "-fPIC")) {
             opt_fpic = true;
             continue;
@@ -83,16 +139,99 @@ static void parse_args(int argc, char **argv) {
             continue;
         }
 
+        if (!strcmp(argv[i], "-g")) {
+            opt_g = true;
+            explicit_g = true;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "-g0")) {
+            opt_g = false;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--emit-pch")) {
+            opt_emit_pch = true;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "-include-pch")) {
+            if (!argv[++i])
+                usage();
+            pch_file = argv[i];
+            continue;
+        }
+
+        if (!strncmp(argv[i], "-fcache-dir=", 12)) {
+            cache_dir = argv[i] + 12;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "-fintegrated-as")) {
+            opt_integrated_as = true;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "-fno-integrated-as")) {
+            opt_integrated_as = false;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "-fno-regalloc")) {
+            opt_regalloc = false;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "-ftime-report")) {
+            opt_time_report = true;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "-ftime-trace")) {
+            opt_time_trace = "";
+            continue;
+        }
+
+        if (!strncmp(argv[i], "-ftime-trace=", 13)) {
+            opt_time_trace = argv[i] + 13;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "-fmem-report")) {
+            opt_mem_report = true;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "-farena-stats")) {
+            opt_arena_stats = true;
+            continue;
+        }
+
         if (argv[i][0] == '-' && argv[i][1] != '\0')
             error("unknown argument: %s", argv[i]);
 
-        input_file = argv[i];
+        input_files[ninput_files++] = argv[i];
     }
 
     include_paths[npaths] = NULL;
 
-    if (!input_file)
+    if (ninput_files == 0)
         error("no input files");
+    if (opt_j < 1)
+        error("invalid -j value");
+    if (ninput_files > 1 && output_file)
+        error("cannot specify -o with multiple files");
+    if (ninput_files > 1 && (opt_E || opt_emit_pch || !(opt_S || opt_c)))
+        error("multiple input files require -S or -c");
+
+    // The built-in assembler doesn't generate line tables, so don't
+    // bother writing line information for it.
+    if (opt_c && opt_integrated_as && opt_g) {
+        if (explicit_g)
+            fprintf(stderr, "warning: -g is ignored by the integrated assembler; "
+                            "use -fno-integrated-as for debug info\n");
+        opt_g = false;
+    }
 }
 
 static void print_tokens(Token *tok) {
@@ -108,29 +247,58 @@ static void print_tokens(Token *tok) {
     printf("\n");
 }
 
-int main(int argc, char **argv) {
-    init_macros();
-    parse_args(argc, argv);
+// Compiles a given file and writes the result to stdout.
+static void compile1(char *input_file) {
+    if (pch_file) {
+        timer_start("read pch", pch_file);
+        read_pch(pch_file);
+        timer_stop();
+    }
 
     // Tokenize and parse.
     Token *tok = tokenize_file(input_file);
     if (!tok)
         error("%s: %s", input_file, strerror(errno));
 
+    if (opt_emit_pch) {
+        write_pch(tok);
+        return;
+    }
+
+    mem_set_phase(PHASE_PREPROCESS);
+    timer_start("preprocess", NULL);
     tok = preprocess(tok);
+    timer_stop();
 
     if (opt_E) {
         print_tokens(tok);
-        exit(0);
+        return;
+    }
+
+    // If the same token stream was compiled before, reuse its output.
+    char *cache_path = NULL;
+    if (cache_dir) {
+        cache_path = cache_entry(tok);
+        if (cache_read(cache_path))
+            return;
     }
 
+    mem_set_phase(PHASE_PARSE);
+    timer_start("parse", NULL);
     Program *prog = parse(tok);
+    timer_stop();
+
+    timer_start("regalloc", NULL);
+    for (Function *fn = prog->fns; fn; fn = fn->next)
+        alloc_regs(fn);
+    timer_stop();
 
     // Assign offsets to local variables. The last declared lvar become the first lvar in the stack.
+    timer_start("assign offsets", NULL);
     for (Function *fn = prog->fns; fn; fn = fn->next) {
-        // Besides local variables, callee-saved registers taken 32 bytes
-        // and the variable-argument save area takes 96 bytes in the stack.
-        int offset = fn->is_variadic ? 128 : 32;
+        // Besides local variables, callee-saved registers taken 40 bytes
+        // and the variable-argument save area takes 176 bytes in the stack.
+        int offset = fn->is_variadic ? 216 : 40;
 
         for (Var *var = fn->locals; var; var = var->next) {
             offset = align_to(offset, var->align);
@@ -139,9 +307,169 @@ int main(int argc, char **argv) {
         }
         fn->stack_size = align_to(offset, 16);
     }
+    timer_stop();
 
     // Traverse the AST to emit assembly.
+    if (cache_path)
+        cache_begin(cache_path);
+    mem_set_phase(PHASE_CODEGEN);
+    timer_start("codegen", NULL);
     codegen(prog);
+    timer_stop();
+    if (cache_path)
+        cache_end();
+}
+
+static void compile(char *input_file) {
+    timer_start("total", input_file);
+    compile1(input_file);
+    timer_stop();
+
+    // Tokens and the AST are dead once the output has been written.
+    // A process compiles only one translation unit, so they can be
+    // freed before the object file is assembled.
+    arena_release(&token_arena);
+    arena_release(&ast_arena);
+}
+
+// Replaces the extension of a given filename, e.g. "dir/foo.c" to
+// "dir/foo.s".
+static char *replace_extn(char *path, char *extn) {
+    char *dot = strrchr(path, '.');
+    char *slash = strrchr(path, '/');
+    int len = (dot && (!slash || dot > slash)) ? dot - path : strlen(path);
+
+    char *buf = malloc(len + strlen(extn) + 1);
+    sprintf(buf, "%.*s%s", len, path, extn);
+    return buf;
+}
+
+// Prints the statistics requested by -farena-stats, -fmem-report,
+// -ftime-report and -ftime-trace after compiling a given file.
+static void print_stats(char *input_file) {
+    if (opt_arena_stats)
+        print_arena_stats();
+    if (opt_mem_report)
+        print_mem_report();
+    if (opt_time_report)
+        print_time_report();
+    if (opt_time_trace)
+        write_time_trace(*opt_time_trace ? opt_time_trace : replace_extn(input_file, ".json"));
+}
+
+// Runs a command and waits for it. Returns true on success.
+static bool run_command(char **argv) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == -1)
+        error("fork failed: %s", strerror(errno));
+
+    if (pid == 0) {
+        execvp(argv[0], argv);
+        fprintf(stderr, "exec failed: %s: %s\n", argv[0], strerror(errno));
+        _exit(1);
+    }
+
+    int status;
+    while (waitpid(pid, &status, 0) == -1)
+        if (errno != EINTR)
+            return false;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Temporary assembly file of a worker. It is removed if the worker
+// fails, so that no truncated output is left behind.
+static char *tmp_file;
+
+static void cleanup(void) {
+    if (tmp_file)
+        unlink(tmp_file);
+}
+
+// Compiles a given file to an assembly or object file. This runs in
+// a worker process of its own, so compiler state that is global to
+// the process is private to the translation unit.
+static int compile_to_file(char *input, char *output) {
+    if (opt_S && !strcmp(output, "-")) {
+        compile(input);
+        print_stats(input);
+        return 0;
+    }
+
+    tmp_file = replace_extn(output, ".zcc-tmp.s");
+    atexit(cleanup);
+    redirect_stdout(tmp_file);
+    compile(input);
+    fflush(stdout);
+
+    if (opt_S) {
+        if (rename(tmp_file, output))
+            error("cannot rename %s to %s: %s", tmp_file, output, strerror(errno));
+        tmp_file = NULL;
+        print_stats(input);
+        return 0;
+    }
+
+    timer_start("assemble", output);
+    bool ok = true;
+    if (opt_integrated_as) {
+        assemble(tmp_file, output);
+    } else {
+        char *argv[] = {"as", "-o", output, tmp_file, NULL};
+        ok = run_command(argv);
+    }
+    timer_stop();
+
+    print_stats(input);
+    return ok ? 0 : 1;
+}
+
+// Compiles all input files with up to `opt_j` workers at a time.
+static int run_workers(void) {
+    int running = 0;
+    int failed = 0;
+
+    for (int i = 0; i < ninput_files || running > 0;) {
+        if (i < ninput_files && running < opt_j) {
+            char *input = input_files[i++];
+            char *output = output_file;
+            if (!output)
+                output = replace_extn(input, opt_S ? ".s" : ".o");
+
+            fflush(stdout);
+            fflush(stderr);
+            pid_t pid = fork();
+            if (pid == -1)
+                error("fork failed: %s", strerror(errno));
+            if (pid == 0)
+                exit(compile_to_file(input, output));
+            running++;
+            continue;
+        }
+
+        int status;
+        if (wait(&status) == -1) {
+            if (errno == EINTR)
+                continue;
+            error("wait failed: %s", strerror(errno));
+        }
+        running--;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            failed = 1;
+    }
+    return failed;
+}
+
+int main(int argc, char **argv) {
+    init_macros();
+    parse_args(argc, argv);
+
+    if (opt_S || opt_c)
+        return run_workers();
 
+    if (output_file)
+        redirect_stdout(output_file);
+    compile(input_files[0]);
+    print_stats(input_files[0]);
     return 0;
 }
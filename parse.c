@@ -23,6 +23,7 @@
 typedef struct VarScope VarScope;
 struct VarScope {
     VarScope *next;
+    VarScope *shadowed; // Same name in an enclosing scope
     char *name;
     int depth;
 
@@ -36,6 +37,7 @@ struct VarScope {
 typedef struct TagScope TagScope;
 struct TagScope {
     TagScope *next;
+    TagScope *shadowed; // Same tag in an enclosing scope
     char *name;
     int depth;
     Type *ty;
@@ -90,8 +92,14 @@ static Var *globals;
 
 // C has two block scopes; one is for variables/typedefs and
 // the other is for struct/union/enum tags.
+//
+// Each list holds the scope entries in the order they were pushed,
+// which serves as the undo log for leave_scope(). Lookups go through
+// the hash maps, which map an interned name to its innermost entry.
 static VarScope *var_scope;
 static TagScope *tag_scope;
+static HashMap var_map;
+static HashMap tag_map;
 
 // scope_depth is incremented by one at "{" and decremented
 // by one at "}".
@@ -104,6 +112,10 @@ static Var *current_fn;
 // a switch statement. Otherwise, NULL.
 static Node *current_switch;
 
+// Sequence number for anonymous global variables such as string
+// literals. It starts from zero for each translation unit.
+static int gvar_seq;
+
 static bool is_typename(Token *tok);
 static Type *typespec(Token **rest, Token *tok, VarAttr *attr);
 static Type *typename(Token **rest, Token *tok);
@@ -147,33 +159,42 @@ static void enter_scope(void) {
     scope_depth++;
 }
 
+// Pops all entries of the innermost scope, making the entries they
+// shadowed visible again.
 static void leave_scope(void) {
     scope_depth--;
 
-    while (var_scope && var_scope->depth > scope_depth)
-        var_scope = var_scope->next;
+    for (; var_scope && var_scope->depth > scope_depth; var_scope = var_scope->next) {
+        if (var_scope->shadowed)
+            hashmap_put(&var_map, var_scope->name, var_scope->shadowed);
+        else
+            hashmap_delete(&var_map, var_scope->name);
+    }
 
-    while (tag_scope && tag_scope->depth > scope_depth)
-        tag_scope = tag_scope->next;
+    for (; tag_scope && tag_scope->depth > scope_depth; tag_scope = tag_scope->next) {
+        if (tag_scope->shadowed)
+            hashmap_put(&tag_map, tag_scope->name, tag_scope->shadowed);
+        else
+            hashmap_delete(&tag_map, tag_scope->name);
+    }
 }
 
 // Find a variable or a typedef by name.
 static VarScope *find_var(Token *tok) {
-    for (VarScope *sc = var_scope; sc; sc = sc->next)
-        if (strlen(sc->name) == tok->len && !strncmp(tok->loc, sc->name, tok->len))
-            return sc;
-    return NULL;
+    if (!tok->sym)
+        return NULL;
+    return hashmap_get3(&var_map, tok->sym, tok->len, tok->hash);
 }
 
 static TagScope *find_tag(Token *tok) {
-    for (TagScope *sc = tag_scope; sc; sc = sc->next)
-        if (strlen(sc->name) == tok->len && !strncmp(tok->loc, sc->name, tok->len))
-            return sc;
-    return NULL;
+    if (!tok->sym)
+        return NULL;
+    return hashmap_get3(&tag_map, tok->sym, tok->len, tok->hash);
 }
 
 static Node *new_node(NodeKind kind, Token *tok) {
-    Node *node = calloc(1, sizeof(Node));
+    Node *node = arena_alloc(&ast_arena, sizeof(Node));
+    mem_count(MEM_NODE, sizeof(Node));
     node->kind = kind;
     node->tok = tok;
     return node;
@@ -214,7 +235,8 @@ static Node *new_var_node(Var *var, Token *tok) {
 Node *new_cast(Node *expr, Type *ty) {
     add_type(expr);
 
-    Node *node = calloc(1, sizeof(Node));
+    Node *node = arena_alloc(&ast_arena, sizeof(Node));
+    mem_count(MEM_NODE, sizeof(Node));
     node->kind = ND_CAST;
     node->tok = expr->tok;
     node->lhs = expr;
@@ -223,27 +245,31 @@ Node *new_cast(Node *expr, Type *ty) {
 }
 
 static VarScope *push_scope(char *name) {
-    VarScope *sc = calloc(1, sizeof(VarScope));
+    VarScope *sc = arena_alloc(&ast_arena, sizeof(VarScope));
     sc->next = var_scope;
+    sc->shadowed = hashmap_get(&var_map, name);
     sc->name = name;
     sc->depth = scope_depth;
     var_scope = sc;
+    hashmap_put(&var_map, name, sc);
     return sc;
 }
 
 static Initializer *new_init(Type *ty, int len, Node *expr, Token *tok) {
-    Initializer *init = calloc(1, sizeof(Initializer));
+    Initializer *init = arena_alloc(&ast_arena, sizeof(Initializer));
+    mem_count(MEM_INITIALIZER, sizeof(Initializer) + sizeof(Initializer *) * len);
     init->ty = ty;
     init->tok = tok;
     init->len = len;
     init->expr = expr;
     if (len)
-        init->children = calloc(len, sizeof(Initializer *));
+        init->children = arena_alloc(&ast_arena, sizeof(Initializer *) * len);
     return init;
 }
 
 static Var *new_lvar(char *name, Type *ty) {
-    Var *var = calloc(1, sizeof(Var));
+    Var *var = arena_alloc(&ast_arena, sizeof(Var));
+    mem_count(MEM_VAR, sizeof(Var));
     var->name = name;
     var->ty = ty;
     var->align = ty->align;
@@ -255,7 +281,8 @@ static Var *new_lvar(char *name, Type *ty) {
 }
 
 static Var *new_gvar(char *name, Type *ty, bool is_static, bool emit) {
-    Var *var = calloc(1, sizeof(Var));
+    Var *var = arena_alloc(&ast_arena, sizeof(Var));
+    mem_count(MEM_VAR, sizeof(Var));
     var->name = name;
     var->ty = ty;
     var->align = ty->align;
@@ -270,9 +297,8 @@ static Var *new_gvar(char *name, Type *ty, bool is_static, bool emit) {
 }
 
 static char *new_gvar_name(void) {
-    static int cnt = 0;
     char *buf = malloc(20);
-    sprintf(buf, ".L.data.%d", cnt++);
+    sprintf(buf, ".L.data.%d", gvar_seq++);
     return buf;
 }
 
@@ -286,7 +312,7 @@ static Var *new_string_literal(char *p, int len) {
 static char *get_ident(Token *tok) {
     if (tok->kind != TK_IDENT)
         error_tok(tok, "expected an identifier");
-    return strndup(tok->loc, tok->len);
+    return tok->sym;
 }
 
 static Type *find_typedef(Token *tok) {
@@ -301,23 +327,25 @@ static Type *find_typedef(Token *tok) {
 static long get_number(Token *tok) {
     if (tok->kind != TK_NUM)
         error_tok(tok, "expected a number");
-    return tok->val;
+    return tok->lit->val;
 }
 
 static void push_tag_scope(Token *tok, Type *ty) {
-    TagScope *sc = calloc(1, sizeof(TagScope));
+    TagScope *sc = arena_alloc(&ast_arena, sizeof(TagScope));
     sc->next = tag_scope;
-    sc->name = strndup(tok->loc, tok->len);
+    sc->shadowed = find_tag(tok);
+    sc->name = tok->sym;
     sc->depth = scope_depth;
     sc->ty = ty;
     tag_scope = sc;
+    hashmap_put3(&tag_map, sc->name, tok->len, tok->hash, sc);
 }
 
 // Create a node for "__func__" local variable and add that
 // to the current scope.
 static void add_func_ident(char *func) {
     Var *var = new_string_literal(func, strlen(func) + 1); // last 1 for `\0`
-    push_scope("__func__")->var = var;
+    push_scope(intern("__func__", 8))->var = var;
 }
 
 // funcdef = typespec declarator compound-stmt
@@ -331,7 +359,7 @@ static Function *funcdef(Token **rest, Token *tok) {
     if (!ty->name)
         error_tok(ty->name_pos, "function name omitted");
 
-    Function *fn = calloc(1, sizeof(Function));
+    Function *fn = arena_alloc(&ast_arena, sizeof(Function));
     fn->name = get_ident(ty->name);
     fn->is_static = attr.is_static;
     fn->is_variadic = ty->is_variadic;
@@ -389,16 +417,17 @@ static Type *typespec(Token **rest, Token *tok, VarAttr *attr) {
     Type *ty = ty_int;
     int counter = 0;
     bool is_const = false;
+    bool is_volatile = false;
 
     while (is_typename(tok)) {
         // Handle storage class specifiers.
-        if (equal(tok, "typedef") || equal(tok, "static") || equal(tok, "extern")) {
+        if (tok->id == KW_TYPEDEF || tok->id == KW_STATIC || tok->id == KW_EXTERN) {
             if (!attr)
                 error_tok(tok, "storage class specifier is not allowed in this context");
             
-            if (equal(tok, "typedef"))
+            if (tok->id == KW_TYPEDEF)
                 attr->is_typedef = true;
-            else if (equal(tok, "static"))
+            else if (tok->id == KW_STATIC)
                 attr->is_static = true;
             else
                 attr->is_extern = true;
@@ -414,10 +443,15 @@ static Type *typespec(Token **rest, Token *tok, VarAttr *attr) {
             continue;
         }
 
-        if (consume(&tok, tok, "volatile"))
+        if (consume(&tok, tok, "volatile")) {
+            is_volatile = true;
+            continue;
+        }
+
+        if (consume(&tok, tok, "restrict"))
             continue;
 
-        if (equal(tok, "_Alignas")) {
+        if (tok->id == KW_ALIGNAS) {
             if (!attr)
                 error_tok(tok, "_Alignas is not allowed in this context");
             tok = skip(tok->next, "(");
@@ -432,15 +466,15 @@ static Type *typespec(Token **rest, Token *tok, VarAttr *attr) {
 
         // Handle user-defined types.
         Type *ty2 = find_typedef(tok);
-        if (equal(tok, "struct") || equal(tok, "union") || equal(tok, "enum") || ty2) {
+        if (tok->id == KW_STRUCT || tok->id == KW_UNION || tok->id == KW_ENUM || ty2) {
             if (counter)
                 break;
 
-            if (equal(tok, "struct")) {
+            if (tok->id == KW_STRUCT) {
                 ty = struct_decl(&tok, tok->next);
-            } else if (equal(tok, "union")) {
+            } else if (tok->id == KW_UNION) {
                 ty = union_decl(&tok, tok->next);
-            } else if (equal(tok, "enum")) {
+            } else if (tok->id == KW_ENUM) {
                 ty = enum_specifier(&tok, tok->next);
             } else {
                 ty = ty2;
@@ -452,28 +486,40 @@ static Type *typespec(Token **rest, Token *tok, VarAttr *attr) {
         }
 
         // Handle built-in types. 
-        if (equal(tok, "void"))
+        switch (tok->id) {
+        case KW_VOID:
             counter += VOID;
-        else if (equal(tok, "_Bool"))
+            break;
+        case KW_BOOL:
             counter += BOOL;
-        else if (equal(tok, "char"))
+            break;
+        case KW_CHAR:
             counter += CHAR;
-        else if (equal(tok, "short"))
+            break;
+        case KW_SHORT:
             counter += SHORT;
-        else if (equal(tok, "int"))
+            break;
+        case KW_INT:
             counter += INT;
-        else if (equal(tok, "long"))
+            break;
+        case KW_LONG:
             counter += LONG;
-        else if (equal(tok, "float"))
+            break;
+        case KW_FLOAT:
             counter += FLOAT;
-        else if (equal(tok, "double"))
+            break;
+        case KW_DOUBLE:
             counter += DOUBLE;
-        else if (equal(tok, "signed"))
+            break;
+        case KW_SIGNED:
             counter |= SIGNED;
-        else if (equal(tok, "unsigned"))
+            break;
+        case KW_UNSIGNED:
             counter |= UNSIGNED;
-        else
+            break;
+        default:
             error_tok(tok, "internal error");
+        }
         
         switch (counter) {
         case VOID:
@@ -546,9 +592,10 @@ static Type *typespec(Token **rest, Token *tok, VarAttr *attr) {
         tok = tok->next;
     }
 
-    if (is_const) {
+    if (is_const || is_volatile) {
         ty = copy_type(ty);
-        ty->is_const = true;
+        ty->is_const |= is_const;
+        ty->is_volatile |= is_volatile;
     }
 
     *rest = tok;
@@ -558,7 +605,7 @@ static Type *typespec(Token **rest, Token *tok, VarAttr *attr) {
 // func-params = ("void" | param ("," param)* ("," "...")?)? ")"
 // param       = typespec declarator
 static Type *func_params(Token **rest, Token *tok, Type *ty) {
-    if (equal(tok, "void") && equal(tok->next, ")")) {
+    if (tok->id == KW_VOID && tok->next->id == P_RPAREN) {
         *rest = tok->next->next;
         return func_type(ty);
     }
@@ -567,11 +614,11 @@ static Type *func_params(Token **rest, Token *tok, Type *ty) {
     Type *cur = &head;
     bool is_variadic = false;
 
-    while (!equal(tok, ")")) {
+    while (tok->id != P_RPAREN) {
         if (cur != &head)
             tok = skip(tok, ",");
 
-        if (equal(tok, "...")) {
+        if (tok->id == P_ELLIPSIS) {
             is_variadic = true;
             tok = tok->next;
             skip(tok, ")");
@@ -601,7 +648,7 @@ static Type *func_params(Token **rest, Token *tok, Type *ty) {
 
 // array-dimensions = const-expr? "]" type-suffix
 static Type *array_dimensions(Token **rest, Token *tok, Type *ty) {
-    if (equal(tok, "]")) {
+    if (tok->id == P_RBRACKET) {
         ty = type_suffix(rest, tok->next, ty);
         ty = array_of(ty, 0);
         ty->is_incomplete = true;
@@ -618,23 +665,25 @@ static Type *array_dimensions(Token **rest, Token *tok, Type *ty) {
 //             | "[" array-dimensions
 //             | ε
 static Type *type_suffix(Token **rest, Token *tok, Type *ty) {
-    if (equal(tok, "("))
+    if (tok->id == P_LPAREN)
         return func_params(rest, tok->next, ty);
 
-    if (equal(tok, "["))
+    if (tok->id == P_LBRACKET)
         return array_dimensions(rest, tok->next, ty);
 
     *rest = tok;
     return ty;
 }
 
-// pointers = ("*" ("const" | "volatile")*)*
+// pointers = ("*" ("const" | "volatile" | "restrict")*)*
 static Type *pointers(Token **rest, Token *tok, Type *ty) {
     while (consume(&tok, tok, "*")) {
         ty = pointer_to(ty);
-        while (equal(tok, "const") || equal(tok, "volatile")) {
-            if (equal(tok, "const"))
+        while (tok->id == KW_CONST || tok->id == KW_VOLATILE || tok->id == KW_RESTRICT) {
+            if (tok->id == KW_CONST)
                 ty->is_const = true;
+            else if (tok->id == KW_VOLATILE)
+                ty->is_volatile = true;
             tok = tok->next;
         }
     }
@@ -646,8 +695,9 @@ static Type *pointers(Token **rest, Token *tok, Type *ty) {
 static Type *declarator(Token **rest, Token *tok, Type *ty) {
     ty = pointers(&tok, tok, ty);
 
-    if (equal(tok, "(")) {
-        Type *placeholder = calloc(1, sizeof(Type));
+    if (tok->id == P_LPAREN) {
+        Type *placeholder = arena_alloc(&type_arena, sizeof(Type));
+        mem_count(MEM_TYPE, sizeof(Type));
         Type *new_ty = declarator(&tok, tok->next, placeholder);
         tok = skip(tok, ")");
         *placeholder = *type_suffix(rest, tok, ty);
@@ -672,8 +722,9 @@ static Type *declarator(Token **rest, Token *tok, Type *ty) {
 static Type *abstract_declarator(Token **rest, Token *tok, Type *ty) {
     ty = pointers(&tok, tok, ty);
 
-    if (equal(tok, "(")) {
-        Type *placeholder = calloc(1, sizeof(Type));
+    if (tok->id == P_LPAREN) {
+        Type *placeholder = arena_alloc(&type_arena, sizeof(Type));
+        mem_count(MEM_TYPE, sizeof(Type));
         Type *new_ty = abstract_declarator(&tok, tok->next, placeholder);
         tok = skip(tok, ")");
         *placeholder = *type_suffix(rest, tok, ty);
@@ -690,16 +741,16 @@ static Type *typename(Token **rest, Token *tok) {
 }
 
 static bool is_end(Token *tok) {
-    return equal(tok, "}") || (equal(tok, ",") && equal(tok->next, "}"));
+    return tok->id == P_RBRACE || (tok->id == P_COMMA && tok->next->id == P_RBRACE);
 }
 
 static bool consume_end(Token **rest, Token *tok) {
-    if (equal(tok, "}")) {
+    if (tok->id == P_RBRACE) {
         *rest = tok->next;
         return true;
     }
 
-    if (equal(tok, ",") && equal(tok->next, "}")) {
+    if (tok->id == P_COMMA && tok->next->id == P_RBRACE) {
         *rest = tok->next->next;
         return true;
     }
@@ -721,7 +772,7 @@ static Type *enum_specifier(Token **rest, Token *tok) {
         tok = tok->next;
     }
 
-    if (tag && !equal(tok, "{")) { // e.g. enum tag ident;
+    if (tag && tok->id != P_LBRACE) { // e.g. enum tag ident;
         TagScope *sc = find_tag(tag);
         if (!sc)
             error_tok(tag, "unknown enum type");
@@ -743,7 +794,7 @@ static Type *enum_specifier(Token **rest, Token *tok) {
         char *name = get_ident(tok);
         tok = tok->next;
 
-        if (equal(tok, "="))
+        if (tok->id == P_ASSIGN)
             val = const_expr(&tok, tok->next);
 
         VarScope *sc = push_scope(name);
@@ -765,7 +816,7 @@ static Node *declaration(Token **rest, Token *tok) {
     Node *cur = &head;
     int cnt = 0;
 
-    while (!equal(tok, ";")) {
+    while (tok->id != P_SEMICOLON) {
         if (cnt++ > 0)
             tok = skip(tok, ",");
         
@@ -785,7 +836,7 @@ static Node *declaration(Token **rest, Token *tok) {
             Var *var = new_gvar(new_gvar_name(), ty, true, true);
             push_scope(get_ident(ty->name))->var = var;
 
-            if (equal(tok, "="))
+            if (tok->id == P_ASSIGN)
                 gvar_initializer(&tok, tok->next, var);
                 continue;
         }
@@ -794,7 +845,7 @@ static Node *declaration(Token **rest, Token *tok) {
         if (attr.align)
             var->align = attr.align;
 
-        if (equal(tok, "=")) {
+        if (tok->id == P_ASSIGN) {
             Node *expr = lvar_initializer(&tok, tok->next, var);
             cur = cur->next = new_unary(ND_EXPR_STMT, expr, tok);
         }
@@ -809,7 +860,7 @@ static Node *declaration(Token **rest, Token *tok) {
 static Token *skip_excess_elements(Token *tok) {
     while (!consume_end(&tok, tok)) {
         tok = skip(tok, ",");
-        if (equal(tok, "{"))
+        if (tok->id == P_LBRACE)
             tok = skip_excess_elements(tok->next);
         else
             assign(&tok, tok);
@@ -828,18 +879,18 @@ static Token *skip_end(Token *tok) {
 static Initializer *string_initializer(Token **rest, Token *tok, Type *ty) {
     // Initialize a char array with a string literal.
     if (ty->is_incomplete) {
-        ty->size = tok->cont_len;
-        ty->array_len = tok->cont_len;
+        ty->size = tok->lit->cont_len;
+        ty->array_len = tok->lit->cont_len;
         ty->is_incomplete = false;
     }
 
     Initializer *init = new_init(ty, ty->array_len, NULL, tok);
 
-    int len = (ty->array_len < tok->cont_len)
-        ? ty->array_len : tok->cont_len;
+    int len = (ty->array_len < tok->lit->cont_len)
+        ? ty->array_len : tok->lit->cont_len;
 
     for (int i = 0; i < len; i++) {
-        Node *expr = new_num(tok->contents[i], tok);
+        Node *expr = new_num(tok->lit->contents[i], tok);
         init->children[i] = new_init(ty->base, 0, expr, tok);
     }
     *rest = tok->next;
@@ -881,7 +932,7 @@ static Initializer *array_initializer(Token **rest, Token *tok, Type *ty) {
 // struct-initializer = "{" initializer ("," initializer)* ","? "}"
 //                    | initializer ("," initializer)* ","
 static Initializer *struct_initializer(Token **rest, Token *tok, Type *ty) {
-    if (!equal(tok, "{")) { // e.g. struct tag x = num;
+    if (tok->id != P_LBRACE) { // e.g. struct tag x = num;
         Token *tok2;
         Node *expr = assign(&tok2, tok);
         add_type(expr);
@@ -1075,7 +1126,7 @@ write_gvar_data(Relocation *cur, Initializer *init, Type *ty, char *buf, int off
     long val = eval2(init->expr, &var);
 
     if (var) {
-        Relocation *rel = calloc(1, sizeof(Relocation));
+        Relocation *rel = arena_alloc(&ast_arena, sizeof(Relocation));
         rel->offset = offset;
         rel->label = var->name;
         rel->addend = val;
@@ -1103,15 +1154,29 @@ static void gvar_initializer(Token **rest, Token *tok, Var *var) {
 
 // Returns true if a given token represents a type.
 static bool is_typename(Token *tok) {
-    static char *kw[] = {
-        "void", "_Bool", "char", "short", "int", "long", "float", "double",
-        "struct", "union", "typedef", "enum", "static", "extern", "_Alignas",
-        "signed", "unsigned", "const", "volatile",
-    };
-
-    for (int i = 0; i < sizeof(kw) / sizeof(*kw); i++)
-        if (equal(tok, kw[i]))
-            return true;
+    switch (tok->id) {
+    case KW_VOID:
+    case KW_BOOL:
+    case KW_CHAR:
+    case KW_SHORT:
+    case KW_INT:
+    case KW_LONG:
+    case KW_FLOAT:
+    case KW_DOUBLE:
+    case KW_STRUCT:
+    case KW_UNION:
+    case KW_TYPEDEF:
+    case KW_ENUM:
+    case KW_STATIC:
+    case KW_EXTERN:
+    case KW_ALIGNAS:
+    case KW_SIGNED:
+    case KW_UNSIGNED:
+    case KW_CONST:
+    case KW_VOLATILE:
+    case KW_RESTRICT:
+        return true;
+    }
     return find_typedef(tok);
 }
 
@@ -1131,7 +1196,7 @@ static bool is_typename(Token *tok) {
 //      | "{" compound-stmt
 //      | expr ";"
 static Node *stmt(Token **rest, Token *tok) {
-    if (equal(tok, "return")) {
+    if (tok->id == KW_RETURN) {
         Node *node = new_node(ND_RETURN, tok);
         if (consume(rest, tok->next, ";"))
             return node;
@@ -1144,19 +1209,19 @@ static Node *stmt(Token **rest, Token *tok) {
         return node;
     }
 
-    if (equal(tok, "if")) {
+    if (tok->id == KW_IF) {
         Node *node = new_node(ND_IF, tok);
         tok = skip(tok->next, "(");
         node->cond = expr(&tok, tok);
         tok = skip(tok, ")");
         node->then = stmt(&tok, tok);
-        if (equal(tok, "else"))
+        if (tok->id == KW_ELSE)
             node->els = stmt(&tok, tok->next);
         *rest = tok;
         return node;
     }
 
-    if (equal(tok, "switch")) {
+    if (tok->id == KW_SWITCH) {
         Node *node = new_node(ND_SWITCH, tok);
         tok = skip(tok->next, "(");
         node->cond = expr(&tok, tok);
@@ -1169,7 +1234,7 @@ static Node *stmt(Token **rest, Token *tok) {
         return node;
     }
 
-    if (equal(tok, "case")) {
+    if (tok->id == KW_CASE) {
         if (!current_switch)
             error_tok(tok, "stray case");
 
@@ -1183,7 +1248,7 @@ static Node *stmt(Token **rest, Token *tok) {
         return node;
     }
 
-    if (equal(tok, "default")) {
+    if (tok->id == KW_DEFAULT) {
         if (!current_switch)
             error_tok(tok, "stray default");
         
@@ -1194,7 +1259,7 @@ static Node *stmt(Token **rest, Token *tok) {
         return node;
     }
 
-    if (equal(tok, "for")) {
+    if (tok->id == KW_FOR) {
         Node *node = new_node(ND_FOR, tok);
         tok = skip(tok->next, "(");
 
@@ -1203,16 +1268,16 @@ static Node *stmt(Token **rest, Token *tok) {
         if (is_typename(tok)) {
             node->init = declaration(&tok, tok);
         } else {
-            if (!equal(tok, ";"))
+            if (tok->id != P_SEMICOLON)
                 node->init = expr_stmt(&tok, tok);
             tok = skip(tok, ";");
         }
 
-        if (!equal(tok, ";"))
+        if (tok->id != P_SEMICOLON)
             node->cond = expr(&tok, tok);
         tok = skip(tok, ";");
 
-        if (!equal(tok, ")"))
+        if (tok->id != P_RPAREN)
             node->inc = expr_stmt(&tok, tok);
         tok = skip(tok, ")");
 
@@ -1221,7 +1286,7 @@ static Node *stmt(Token **rest, Token *tok) {
         return node;
     }
 
-    if (equal(tok, "while")) { // "while" is the same as "for" without init and inc
+    if (tok->id == KW_WHILE) { // "while" is the same as "for" without init and inc
         Node *node = new_node(ND_FOR, tok);
         tok = skip(tok->next, "(");
         node->cond = expr(&tok, tok);
@@ -1230,7 +1295,7 @@ static Node *stmt(Token **rest, Token *tok) {
         return node;
     }
 
-    if (equal(tok, "do")) {
+    if (tok->id == KW_DO) {
         Node *node = new_node(ND_DO, tok);
         node->then = stmt(&tok, tok->next);
         tok = skip(tok, "while");
@@ -1241,37 +1306,37 @@ static Node *stmt(Token **rest, Token *tok) {
         return node;
     }
 
-    if (equal(tok, "break")) {
+    if (tok->id == KW_BREAK) {
         *rest = skip(tok->next, ";");
         return new_node(ND_BREAK, tok);
     }
 
-    if (equal(tok, "continue")) {
+    if (tok->id == KW_CONTINUE) {
         *rest = skip(tok->next, ";");
         return new_node(ND_CONTINUE, tok);
     }
 
-    if (equal(tok, "goto")) {
+    if (tok->id == KW_GOTO) {
         Node *node = new_node(ND_GOTO, tok);
         node->label_name = get_ident(tok->next);
         *rest = skip(tok->next->next, ";");
         return node;
     }
 
-    if (equal(tok, ";")) {
+    if (tok->id == P_SEMICOLON) {
         Node *node = new_node(ND_BLOCK, tok);
         *rest = tok->next;
         return node;
     }
 
-    if (tok->kind == TK_IDENT && equal(tok->next, ":")) {
+    if (tok->kind == TK_IDENT && tok->next->id == P_COLON) {
         Node *node = new_node(ND_LABEL, tok);
-        node->label_name = strndup(tok->loc, tok->len);
+        node->label_name = tok->sym;
         node->lhs = stmt(rest, tok->next->next);
         return node;
     }
 
-    if (equal(tok, "{"))
+    if (tok->id == P_LBRACE)
         return compound_stmt(rest, tok->next);
 
     Node *node = expr_stmt(&tok, tok);
@@ -1287,7 +1352,7 @@ static Node *compound_stmt(Token **rest, Token *tok) {
 
     enter_scope();
 
-    while (!equal(tok, "}")) {
+    while (tok->id != P_RBRACE) {
         if (is_typename(tok))
             cur = cur->next = declaration(&tok, tok);
         else
@@ -1313,7 +1378,7 @@ static Node *expr_stmt(Token **rest, Token *tok) {
 static Node *expr(Token **rest, Token *tok) {
     Node *node = assign(&tok, tok);
 
-    if (equal(tok, ","))
+    if (tok->id == P_COMMA)
         return new_binary(ND_COMMA, node, expr(rest, tok->next), tok);
     
     *rest = tok;
@@ -1465,6 +1530,14 @@ static Node *to_assign(Node *binary) {
     add_type(binary->lhs);
     add_type(binary->rhs);
 
+    // A variable can be evaluated twice without side effects, so
+    // `x op= B` becomes `x = x op B`. This keeps x from having its
+    // address taken, so that it can live in a register.
+    if (binary->lhs->kind == ND_VAR) {
+        Token *tok = binary->tok;
+        return new_binary(ND_ASSIGN, new_var_node(binary->lhs->var, tok), binary, tok);
+    }
+
     Var *var = new_lvar("", pointer_to(binary->lhs->ty));
     Token *tok = binary->tok;
 
@@ -1489,37 +1562,37 @@ static Node *to_assign(Node *binary) {
 static Node *assign(Token **rest, Token *tok) {
     Node *node = conditional(&tok, tok);
 
-    if (equal(tok, "="))
+    if (tok->id == P_ASSIGN)
         return new_binary(ND_ASSIGN, node, assign(rest, tok->next), tok);
     
-    if (equal(tok, "+="))
+    if (tok->id == P_ADD_ASSIGN)
         return to_assign(new_add(node, assign(rest, tok->next), tok));
 
-    if (equal(tok, "-="))
+    if (tok->id == P_SUB_ASSIGN)
         return to_assign(new_sub(node, assign(rest, tok->next), tok));
 
-    if (equal(tok, "*="))
+    if (tok->id == P_MUL_ASSIGN)
         return to_assign(new_binary(ND_MUL, node, assign(rest, tok->next), tok));
 
-    if (equal(tok, "/="))
+    if (tok->id == P_DIV_ASSIGN)
         return to_assign(new_binary(ND_DIV, node, assign(rest, tok->next), tok));
 
-    if (equal(tok, "%="))
+    if (tok->id == P_MOD_ASSIGN)
         return to_assign(new_binary(ND_MOD, node, assign(rest, tok->next), tok));
 
-    if (equal(tok, "&="))
+    if (tok->id == P_AND_ASSIGN)
         return to_assign(new_binary(ND_BITAND, node, assign(rest, tok->next), tok));
 
-    if (equal(tok, "|="))
+    if (tok->id == P_OR_ASSIGN)
         return to_assign(new_binary(ND_BITOR, node, assign(rest, tok->next), tok));
 
-    if (equal(tok, "^="))
+    if (tok->id == P_XOR_ASSIGN)
         return to_assign(new_binary(ND_BITXOR, node, assign(rest, tok->next), tok));
 
-    if (equal(tok, "<<="))
+    if (tok->id == P_SHL_ASSIGN)
         return to_assign(new_binary(ND_SHL, node, assign(rest, tok->next), tok));
 
-    if (equal(tok, ">>="))
+    if (tok->id == P_SHR_ASSIGN)
         return to_assign(new_binary(ND_SHR, node, assign(rest, tok->next), tok));
 
     *rest = tok;
@@ -1530,7 +1603,7 @@ static Node *assign(Token **rest, Token *tok) {
 static Node *conditional(Token **rest, Token *tok) {
     Node *node = logor(&tok, tok);
 
-    if (!equal(tok, "?")) {
+    if (tok->id != P_QUESTION) {
         *rest = tok;
         return node;
     }
@@ -1546,7 +1619,7 @@ static Node *conditional(Token **rest, Token *tok) {
 // logor = logand ("||" logand)*
 static Node *logor(Token **rest, Token *tok) {
     Node *node = logand(&tok, tok);
-    while (equal(tok, "||")) {
+    while (tok->id == P_LOGOR) {
         Token *start = tok;
         node = new_binary(ND_LOGOR, node, logand(&tok, tok->next), start);
     }
@@ -1557,7 +1630,7 @@ static Node *logor(Token **rest, Token *tok) {
 // logand = bitor ("&&" bitor)*
 static Node *logand(Token **rest, Token *tok) {
     Node *node = bitor(&tok, tok);
-    while (equal(tok, "&&")) {
+    while (tok->id == P_LOGAND) {
         Token *start = tok;
         node = new_binary(ND_LOGAND, node, bitor(&tok, tok->next), start);
     }
@@ -1568,7 +1641,7 @@ static Node *logand(Token **rest, Token *tok) {
 // bitor = bitxor ("|" bitxor)*
 static Node *bitor(Token **rest, Token *tok) {
     Node *node = bitxor(&tok, tok);
-    while (equal(tok, "|")) {
+    while (tok->id == P_PIPE) {
         Token *start = tok;
         node = new_binary(ND_BITOR, node, bitxor(&tok, tok->next), start);
     }
@@ -1579,7 +1652,7 @@ static Node *bitor(Token **rest, Token *tok) {
 // bitxor = bitand ("^" bitand)*
 static Node *bitxor(Token **rest, Token *tok) {
     Node *node = bitand(&tok, tok);
-    while (equal(tok, "^")) {
+    while (tok->id == P_CARET) {
         Token *start = tok;
         node = new_binary(ND_BITXOR, node, bitand(&tok, tok->next), start);
     }
@@ -1590,7 +1663,7 @@ static Node *bitxor(Token **rest, Token *tok) {
 // bitand = equality ("&" equality)*
 static Node *bitand(Token **rest, Token *tok) {
     Node *node = equality(&tok, tok);
-    while (equal(tok, "&")) {
+    while (tok->id == P_AMP) {
         Token *start = tok;
         node = new_binary(ND_BITAND, node, equality(&tok, tok->next), start);
     }
@@ -1605,12 +1678,12 @@ static Node *equality(Token **rest, Token *tok) {
     for (;;) {
         Token *start = tok;
 
-        if (equal(tok, "==")) {
+        if (tok->id == P_EQ) {
             node = new_binary(ND_EQ, node, relational(&tok, tok->next), start);
             continue;
         }
 
-        if (equal(tok, "!=")) {
+        if (tok->id == P_NE) {
             node = new_binary(ND_NE, node, relational(&tok, tok->next), start);
             continue;
         }
@@ -1627,22 +1700,22 @@ static Node *relational(Token **rest, Token *tok) {
     for (;;) {
         Token *start = tok;
 
-        if (equal(tok, "<")) {
+        if (tok->id == P_LT) {
             node = new_binary(ND_LT, node, shift(&tok, tok->next), start);
             continue;
         }
 
-        if (equal(tok, "<=")) {
+        if (tok->id == P_LE) {
             node = new_binary(ND_LE, node, shift(&tok, tok->next), start);
             continue;
         }
 
-        if (equal(tok, ">")) {
+        if (tok->id == P_GT) {
             node = new_binary(ND_LT, shift(&tok, tok->next), node, start);
             continue;
         }
 
-        if (equal(tok, ">=")) {
+        if (tok->id == P_GE) {
             node = new_binary(ND_LE, shift(&tok, tok->next), node, start);
             continue;
         }
@@ -1659,12 +1732,12 @@ static Node *shift(Token **rest, Token *tok) {
     for (;;) {
         Token *start = tok;
 
-        if (equal(tok, "<<")) {
+        if (tok->id == P_SHL) {
             node = new_binary(ND_SHL, node, add(&tok, tok->next), start);
             continue;
         }
 
-        if (equal(tok, ">>")) {
+        if (tok->id == P_SHR) {
             node = new_binary(ND_SHR, node, add(&tok, tok->next), start);
             continue;
         }
@@ -1733,12 +1806,12 @@ static Node *add(Token **rest, Token *tok) {
     for (;;) {
         Token *start = tok;
 
-        if (equal(tok, "+")) {
+        if (tok->id == P_PLUS) {
             node = new_add(node, mul(&tok, tok->next), start);
             continue;
         }
 
-        if (equal(tok, "-")) {
+        if (tok->id == P_MINUS) {
             node = new_sub(node, mul(&tok, tok->next), start);
             continue;
         }
@@ -1755,17 +1828,17 @@ static Node *mul(Token **rest, Token *tok) {
     for (;;) {
         Token *start = tok;
         
-        if (equal(tok, "*")) {
+        if (tok->id == P_STAR) {
             node = new_binary(ND_MUL, node, cast(&tok, tok->next), start);
             continue;
         }
 
-        if (equal(tok, "/")) {
+        if (tok->id == P_SLASH) {
             node = new_binary(ND_DIV, node, cast(&tok, tok->next), start);
             continue;
         }
 
-        if (equal(tok, "%")) {
+        if (tok->id == P_PERCENT) {
             node = new_binary(ND_MOD, node, cast(&tok, tok->next), start);
             continue;
         }
@@ -1793,12 +1866,12 @@ static Node *compound_literal(Token **rest, Token *tok, Type *ty, Token *start)
 //      | "(" type-name ")" cast 
 //      | unary
 static Node *cast(Token **rest, Token *tok) {
-    if (equal(tok, "(") && is_typename(tok->next)) {
+    if (tok->id == P_LPAREN && is_typename(tok->next)) {
         Token *start = tok;
         Type *ty = typename(&tok, tok->next);
         tok = skip(tok, ")");
 
-        if (equal(tok, "{"))
+        if (tok->id == P_LBRACE)
             return compound_literal(rest, tok, ty, start);
         
         Node *node = new_unary(ND_CAST, cast(rest, tok), start);
@@ -1814,30 +1887,30 @@ static Node *cast(Token **rest, Token *tok) {
 //       | ("++" | "--") unary
 //       | postfix
 static Node *unary(Token **rest, Token *tok) {
-    if (equal(tok, "+"))
+    if (tok->id == P_PLUS)
         return cast(rest, tok->next);
     
-    if (equal(tok, "-"))
+    if (tok->id == P_MINUS)
         return new_binary(ND_SUB, new_num(0, tok), cast(rest, tok->next), tok);        
 
-    if (equal(tok, "&"))
+    if (tok->id == P_AMP)
         return new_unary(ND_ADDR, cast(rest, tok->next), tok);
     
-    if (equal(tok, "*"))
+    if (tok->id == P_STAR)
         return new_unary(ND_DEREF, cast(rest, tok->next), tok);
     
-    if (equal(tok, "!"))
+    if (tok->id == P_NOT)
         return new_unary(ND_NOT, cast(rest, tok->next), tok);
     
-    if (equal(tok, "~"))
+    if (tok->id == P_TILDE)
         return new_unary(ND_BITNOT, cast(rest, tok->next), tok);
     
     // Read ++i as i+=1
-    if (equal(tok, "++"))
+    if (tok->id == P_INC)
         return to_assign(new_add(unary(rest, tok->next), new_num(1, tok), tok));
 
     // Read --i as i-=1
-    if (equal(tok, "--"))
+    if (tok->id == P_DEC)
         return to_assign(new_sub(unary(rest, tok->next), new_num(1, tok), tok));
 
     return postfix(rest, tok);
@@ -1848,16 +1921,25 @@ static Member *struct_members(Token **rest, Token *tok) {
     Member head = {};
     Member *cur = &head;
 
-    while (!equal(tok, "}")) {
+    while (tok->id != P_RBRACE) {
         VarAttr attr = {};
         Type *basety = typespec(&tok, tok, &attr);
         int cnt = 0;
 
+        // Anonymous struct or union member
+        if (basety->kind == TY_STRUCT && consume(&tok, tok, ";")) {
+            Member *mem = arena_alloc(&type_arena, sizeof(Member));
+            mem->ty = basety;
+            mem->align = attr.align ? attr.align : basety->align;
+            cur = cur->next = mem;
+            continue;
+        }
+
         while (!consume(&tok, tok, ";")) {
             if (cnt++)
                 tok = skip(tok, ",");
             
-            Member *mem = calloc(1, sizeof(Member));
+            Member *mem = arena_alloc(&type_arena, sizeof(Member));
             mem->ty = declarator(&tok, tok, basety);
             mem->name = mem->ty->name;
             mem->align = attr.align ? attr.align : mem->ty->align;
@@ -1891,7 +1973,7 @@ static Type *struct_union_decl(Token **rest, Token *tok) {
         tok = tok->next;
     }
 
-    if (tag && !equal(tok, "{")) { // e.g. struct tag ident;
+    if (tag && tok->id != P_LBRACE) { // e.g. struct tag ident;
         *rest = tok;
 
         TagScope *sc = find_tag(tag);
@@ -1975,44 +2057,88 @@ static Type *union_decl(Token **rest, Token *tok) {
     return ty;
 }
 
+// Returns the member named by `tok`, or the anonymous struct or
+// union member that contains it.
 static Member *get_struct_member(Type *ty, Token *tok) {
-    for (Member *mem = ty->members; mem; mem = mem->next)
-        if (mem->name->len == tok->len &&
-                !strncmp(mem->name->loc, tok->loc, tok->len))
+    for (Member *mem = ty->members; mem; mem = mem->next) {
+        if (!mem->name) {
+            if (mem->ty->kind == TY_STRUCT && get_struct_member(mem->ty, tok))
+                return mem;
+            continue;
+        }
+        if (mem->name->sym == tok->sym)
             return mem;
-    error_tok(tok, "no such member");
+    }
+    return NULL;
 }
 
 static Node *struct_ref(Node *lhs, Token *tok) {
     add_type(lhs);
     if (lhs->ty->kind != TY_STRUCT)
         error_tok(lhs->tok, "not a struct");
-        
-    Node *node = new_unary(ND_MEMBER, lhs, tok);
-    node->member = get_struct_member(lhs->ty, tok);
-    return node;
+
+    // Accessing a member of an anonymous member takes one ND_MEMBER
+    // node per level of nesting.
+    Node *node = lhs;
+    Type *ty = lhs->ty;
+    for (;;) {
+        Member *mem = get_struct_member(ty, tok);
+        if (!mem)
+            error_tok(tok, "no such member");
+        node = new_unary(ND_MEMBER, node, tok);
+        node->member = mem;
+        if (mem->name)
+            return node;
+        ty = mem->ty;
+    }
 }
 
-// Convert A++ to `tmp = &A, *tmp = *tmp + 1, *tmp - 1`
-// where tmp is a fresh pointer variable.
+// Returns a new reference to the operand of ++ or --, which is either
+// a variable or `*ptr`.
+static Node *inc_dec_operand(Node *node, Var *ptr, Token *tok) {
+    if (ptr)
+        return new_unary(ND_DEREF, new_var_node(ptr, tok), tok);
+    return new_var_node(node->var, tok);
+}
+
+// Convert A++ to `tmp = &A, (typeof A)((*tmp = *tmp + 1) - 1)`
+// where tmp is a fresh pointer variable. A variable x is used directly
+// as `(typeof x)((x = x + 1) - 1)` for the same reason as in
+// to_assign(). The cast undoes a wraparound, e.g. for a char of 127.
+//
+// The old value of a _Bool or a floating-point number can't be
+// recovered by subtraction, so it is saved in another variable old:
+// `tmp = &A, old = *tmp, *tmp = *tmp + 1, old`.
 static Node *new_inc_dec(Node *node, Token *tok, int addend) {
     add_type(node);
-    Var *var = new_lvar("", pointer_to(node->ty));
 
-    Node *expr1 = new_binary(ND_ASSIGN, new_var_node(var, tok),
-                             new_unary(ND_ADDR, node, tok), tok);
-    
-    Node *expr2 =
-        new_binary(ND_ASSIGN,
-                new_unary(ND_DEREF, new_var_node(var, tok), tok),
-                new_add(new_unary(ND_DEREF, new_var_node(var, tok), tok),
-                        new_num(addend, tok), tok),
-                tok);
-    
-    Node *expr3 = new_add(new_unary(ND_DEREF, new_var_node(var, tok), tok),
-                          new_num(-addend, tok), tok);
-    
-    return new_binary(ND_COMMA, expr1, new_binary(ND_COMMA, expr2, expr3, tok), tok);
+    Var *ptr = NULL;
+    Node *expr1 = NULL;
+    if (node->kind != ND_VAR) {
+        ptr = new_lvar("", pointer_to(node->ty));
+        expr1 = new_binary(ND_ASSIGN, new_var_node(ptr, tok),
+                           new_unary(ND_ADDR, node, tok), tok);
+    }
+
+    Node *inc =
+        new_binary(ND_ASSIGN, inc_dec_operand(node, ptr, tok),
+                   new_add(inc_dec_operand(node, ptr, tok), new_num(addend, tok), tok),
+                   tok);
+
+    Node *expr2;
+    if (node->ty->kind == TY_BOOL || is_flonum(node->ty)) {
+        Var *old = new_lvar("", node->ty);
+        Node *save = new_binary(ND_ASSIGN, new_var_node(old, tok),
+                                inc_dec_operand(node, ptr, tok), tok);
+        expr2 = new_binary(ND_COMMA, save,
+                           new_binary(ND_COMMA, inc, new_var_node(old, tok), tok), tok);
+    } else {
+        expr2 = new_cast(new_add(inc, new_num(-addend, tok), tok), node->ty);
+    }
+
+    if (expr1)
+        return new_binary(ND_COMMA, expr1, expr2, tok);
+    return expr2;
 }
 
 // postfix = ident "(" func-args ")" postfix-tail*
@@ -2025,12 +2151,12 @@ static Node *postfix(Token **rest, Token *tok) {
     Node *node = primary(&tok, tok);
 
     for (;;) {
-        if (equal(tok, "(")) {
+        if (tok->id == P_LPAREN) {
             node = funcall(&tok, tok->next, node);
             continue;
         }
 
-        if (equal(tok, "[")) {
+        if (tok->id == P_LBRACKET) {
             // x[y] is short for *(x+y)
             Token *start = tok;
             Node *idx = expr(&tok, tok->next);
@@ -2039,13 +2165,13 @@ static Node *postfix(Token **rest, Token *tok) {
             continue;
         }
 
-        if (equal(tok, ".")) {
+        if (tok->id == P_DOT) {
             node = struct_ref(node, tok->next);
             tok = tok->next->next;
             continue;
         }
 
-        if (equal(tok, "->")) {
+        if (tok->id == P_ARROW) {
             // x->y is short for (*x).y
             node = new_unary(ND_DEREF, node, tok);
             node = struct_ref(node, tok->next);
@@ -2053,13 +2179,13 @@ static Node *postfix(Token **rest, Token *tok) {
             continue;
         }
 
-        if (equal(tok, "++")) {
+        if (tok->id == P_INC) {
             node = new_inc_dec(node, tok, 1);
             tok = tok->next;
             continue;
         }
 
-        if (equal(tok, "--")) {
+        if (tok->id == P_DEC) {
             node = new_inc_dec(node, tok, -1);
             tok = tok->next;
             continue;
@@ -2087,7 +2213,7 @@ static Node *funcall(Token **rest, Token *tok, Node *fn) {
     Type *ty = (fn->ty->kind == TY_FUNC) ? fn->ty : fn->ty->base;
     Type *param_ty = ty->params;
 
-    while (!equal(tok, ")")) {
+    while (tok->id != P_RPAREN) {
         if (nargs)
             tok = skip(tok, ",");
 
@@ -2128,11 +2254,12 @@ static Node *funcall(Token **rest, Token *tok, Node *fn) {
 //         | "sizeof" "(" type-name ")"
 //         | "sizeof" unary
 //         | "alignof" "(" type-name ")"
+//         | "__builtin_reg_class" "(" type-name ")"
 //         | ident
 //         | str
 //         | num
 static Node *primary(Token **rest, Token *tok) {
-    if (equal(tok, "(") && equal(tok->next, "{")) {
+    if (tok->id == P_LPAREN && tok->next->id == P_LBRACE) {
         // This is a GNU statement expression.
         Node *node = new_node(ND_STMT_EXPR, tok);
         node->body = compound_stmt(&tok, tok->next->next)->body;
@@ -2147,31 +2274,45 @@ static Node *primary(Token **rest, Token *tok) {
         return node;
     }
 
-    if (equal(tok, "(")) {
+    if (tok->id == P_LPAREN) {
         Node *node = expr(&tok, tok->next);
         *rest = skip(tok, ")");
         return node;
     }
 
-    if (equal(tok, "sizeof") && equal(tok->next, "(") && is_typename(tok->next->next)) {
+    if (tok->id == KW_SIZEOF && tok->next->id == P_LPAREN && is_typename(tok->next->next)) {
         Type *ty = typename(&tok, tok->next->next);
         *rest = skip(tok, ")");
         return new_ulong(size_of(ty), tok);
     }
 
-    if (equal(tok, "sizeof")) {
+    if (tok->id == KW_SIZEOF) {
         Node *node = unary(rest, tok->next);
         add_type(node);
         return new_ulong(size_of(node->ty), tok);
     }
 
-    if (equal(tok, "alignof")) {
+    if (tok->id == KW_ALIGNOF) {
         tok = skip(tok->next, "(");
         Type *ty = typename(&tok, tok);
         *rest = skip(tok, ")");
         return new_ulong(ty->align, tok);
     }
 
+    // Returns 1 if a type is passed in an XMM register and 0 if it is
+    // passed in a GP register. Used by va_arg.
+    if (equal(tok, "__builtin_reg_class")) {
+        Token *start = tok;
+        tok = skip(tok->next, "(");
+        Type *ty = typename(&tok, tok);
+        *rest = skip(tok, ")");
+        if (is_flonum(ty))
+            return new_num(1, start);
+        if (is_integer(ty) || ty->kind == TY_PTR)
+            return new_num(0, start);
+        error_tok(start, "va_arg of this type is not supported");
+    }
+
     if (tok->kind == TK_IDENT) {
         // Variable or enum constant
         VarScope *sc = find_var(tok);
@@ -2184,10 +2325,9 @@ static Node *primary(Token **rest, Token *tok) {
                 return new_num(sc->enum_val, tok);
         }
 
-        if (equal(tok->next, "(")) {
+        if (tok->next->id == P_LPAREN) {
             warn_tok(tok, "implicit declaration of a function");
-            char *name = strndup(tok->loc, tok->len);
-            Var *var = new_gvar(name, func_type(ty_int), true, false);
+            Var *var = new_gvar(tok->sym, func_type(ty_int), true, false);
             return new_var_node(var, tok);
         }
 
@@ -2195,7 +2335,7 @@ static Node *primary(Token **rest, Token *tok) {
     }
 
     if (tok->kind == TK_STR) {
-        Var *var = new_string_literal(tok->contents, tok->cont_len);
+        Var *var = new_string_literal(tok->lit->contents, tok->lit->cont_len);
         *rest = tok->next;
         return new_var_node(var, tok);
     }
@@ -2205,22 +2345,24 @@ static Node *primary(Token **rest, Token *tok) {
 
     Node *node;
 
-    if (is_flonum(tok->ty)) {
+    if (is_flonum(tok->lit->ty)) {
         node = new_node(ND_NUM, tok);
-        node->fval = tok->fval;
+        node->fval = tok->lit->fval;
     } else {
-        node = new_num(tok->val, tok);
+        node = new_num(tok->lit->val, tok);
     }
 
-    node->ty = tok->ty;
+    node->ty = tok->lit->ty;
     *rest = tok->next;
     return node;
 }
 
 // program = (funcdef | global-var)*
 Program *parse(Token *tok) {
+    gvar_seq = 0;
+
     // Add built-in function types.
-    new_gvar("__builtin_va_start", func_type(ty_void), true, false);
+    new_gvar(intern("__builtin_va_start", 18), func_type(ty_void), true, false);
 
     // Read source code until EOF.
     Function head = {};
@@ -2253,8 +2395,11 @@ Program *parse(Token *tok) {
         // Function
         if (ty->kind == TY_FUNC) {
             current_fn = new_gvar(get_ident(ty->name), ty, attr.is_static, false);
-            if (!consume(&tok, tok, ";"))
+            if (!consume(&tok, tok, ";")) {
+                timer_start("parse function", current_fn->name);
                 cur = cur->next = funcdef(&tok, start);
+                timer_stop();
+            }
             continue;
         }
 
@@ -2267,7 +2412,7 @@ Program *parse(Token *tok) {
             if (attr.align)
                 var->align = attr.align;
 
-            if (equal(tok, "="))
+            if (tok->id == P_ASSIGN)
                 gvar_initializer(&tok, tok->next, var);
 
             if (consume(&tok, tok, ";"))
@@ -2277,7 +2422,7 @@ Program *parse(Token *tok) {
         }
     }
 
-    Program *prog = calloc(1, sizeof(Program));
+    Program *prog = arena_alloc(&ast_arena, sizeof(Program));
     prog->globals = globals;
     prog->fns = head.next;
     return prog;
@@ -31,21 +31,25 @@ struct MacroParam {
 };
 
 typedef struct MacroArg MacroArg;
+// An actual argument is a view into the token list of the macro
+// invocation. It is the tokens from `tok` up to but not including
+// `end`; the argument is empty if `tok` == `end`.
 struct MacroArg {
     MacroArg *next;
     char *name;
     Token *tok;
+    Token *end;
 };
 
 typedef struct Macro Macro;
 struct Macro {
-    Macro *next;
     char *name;
     bool is_objlike; // Object-like or function-like
     MacroParam *params;
     bool is_variadic;
     Token *body;
     bool deleted;
+    bool from_cmdline; // Given by -D or -U
 };
 
 // `#if` can be nested, so we use a stack to manage nested `#if`s.
@@ -57,13 +61,52 @@ struct CondIncl {
     bool included;
 };
 
+// Hidesets are immutable, hash-consed lists sorted by name address.
+// Two sets with the same names are always the same object, so set
+// equality is a pointer comparison and the results of union and
+// intersection can be memoized on the addresses of their operands.
+// The empty set is NULL.
 typedef struct Hideset Hideset;
 struct Hideset {
-    Hideset *next;
+    Hideset *next; // `next` and `name` form the hash-consing key
     char *name;
 };
 
-static Macro *macros;
+typedef struct {
+    Hideset *hs1; // `hs1` and `hs2` form the memoization key
+    Hideset *hs2;
+    Hideset *result;
+} HidesetOp;
+
+static HashMap hidesets;
+static HashMap hideset_unions;
+static HashMap hideset_intersections;
+
+// All macros, keyed by name. `#undef` replaces an entry with a
+// macro whose `deleted` flag is set.
+static HashMap macros;
+
+// A conservative filter in front of `macros`. A bit is set for each
+// (length, first character) pair that has ever been defined, so most
+// identifiers that are not macros are rejected without hashing them.
+static unsigned char macro_filter[64][16];
+
+// Files that contained `#pragma once`, keyed by file_id()
+static HashMap pragma_once;
+
+// Pristine token lists of headers without include guards, keyed by
+// path. Each inclusion gets a copy because preprocessing relinks the
+// tokens it is given.
+static HashMap file_tokens;
+
+// Guard macro names of headers of the form `#ifndef X #define X ...
+// #endif`, keyed by path. If X is defined, including the file again
+// is a no-op.
+static HashMap include_guards;
+
+// Tokens read from a precompiled header. They precede the main file.
+static Token *pch_tokens;
+
 static Macro *file_macro;
 static Macro *line_macro;
 static CondIncl *cond_incl;
@@ -72,7 +115,7 @@ static Token *preprocess2(Token *tok);
 static Macro *find_macro(Token *tok);
 
 static bool is_hash(Token *tok) {
-    return tok->at_bol && equal(tok, "#");
+    return tok->at_bol && tok->id == P_HASH;
 }
 
 // Some preprocessor directives such as #include allow extraneous
@@ -86,88 +129,170 @@ static Token *skip_line(Token *tok) {
     return tok;
 }
 
-static Token *copy_token(Token *tok) {
-    Token *t = malloc(sizeof(Token));
+static Token *copy_token2(Token *tok, MemKind kind) {
+    Token *t = arena_alloc(&token_arena, sizeof(Token));
+    mem_count(kind, sizeof(Token));
     *t = *tok;
     t->next = NULL;
     return t;
 }
 
+static Token *copy_token(Token *tok) {
+    return copy_token2(tok, MEM_TOKEN_COPY);
+}
+
+static Token *copy_tokens(Token *tok) {
+    Token head = {};
+    Token *cur = &head;
+    for (; tok; tok = tok->next)
+        cur = cur->next = copy_token(tok);
+    return head.next;
+}
+
 static Token *new_eof(Token *tok) {
     Token *t = copy_token(tok);
     t->kind = TK_EOF;
     t->len = 0;
+    t->sym = NULL;
+    t->id = ID_NONE;
     return t;
 }
 
-static Hideset *new_hideset(char *name) {
-    Hideset *hs = calloc(1, sizeof(Hideset));
-    hs->name = name;
+// Returns the unique set {name} + next. `name` must sort before
+// every name in `next`.
+static Hideset *cons_hideset(char *name, Hideset *next) {
+    Hideset key = {next, name};
+    Hideset *hs = hashmap_get2(&hidesets, (char *)&key, sizeof(key));
+    if (hs)
+        return hs;
+
+    hs = arena_alloc(&token_arena, sizeof(Hideset));
+    mem_count(MEM_HIDESET, sizeof(Hideset));
+    *hs = key;
+    hashmap_put2(&hidesets, (char *)hs, sizeof(*hs), hs);
     return hs;
 }
 
-static Hideset *hideset_union(Hideset *hs1, Hideset *hs2) {
-    Hideset head = {};
-    Hideset *cur = &head;
+static Hideset *new_hideset(char *name) {
+    return cons_hideset(name, NULL);
+}
 
-    for (; hs1; hs1 = hs1->next)
-        cur = cur->next = new_hideset(hs1->name);
-    cur->next = hs2;
-    return head.next;
+static HidesetOp *find_hideset_op(HashMap *memo, Hideset *hs1, Hideset *hs2) {
+    HidesetOp key = {hs1, hs2};
+    return hashmap_get2(memo, (char *)&key, 2 * sizeof(Hideset *));
 }
 
-static bool hideset_contains(Hideset *hs, char *s, int len) {
-    for (; hs; hs = hs->next)
-        if (strlen(hs->name) == len && !strncmp(hs->name, s, len))
+static Hideset *
+memo_hideset_op(HashMap *memo, Hideset *hs1, Hideset *hs2, Hideset *result) {
+    HidesetOp *op = arena_alloc(&token_arena, sizeof(HidesetOp));
+    mem_count(MEM_HIDESET, sizeof(HidesetOp));
+    op->hs1 = hs1;
+    op->hs2 = hs2;
+    op->result = result;
+    hashmap_put2(memo, (char *)op, 2 * sizeof(Hideset *), op);
+    return result;
+}
+
+static Hideset *hideset_union(Hideset *hs1, Hideset *hs2) {
+    if (!hs1 || hs1 == hs2)
+        return hs2;
+    if (!hs2)
+        return hs1;
+
+    HidesetOp *op = find_hideset_op(&hideset_unions, hs1, hs2);
+    if (op)
+        return op->result;
+
+    Hideset *hs;
+    if (hs1->name == hs2->name)
+        hs = cons_hideset(hs1->name, hideset_union(hs1->next, hs2->next));
+    else if (hs1->name < hs2->name)
+        hs = cons_hideset(hs1->name, hideset_union(hs1->next, hs2));
+    else
+        hs = cons_hideset(hs2->name, hideset_union(hs1, hs2->next));
+    return memo_hideset_op(&hideset_unions, hs1, hs2, hs);
+}
+
+// Hideset names are interned, so they are compared by pointer.
+static bool hideset_contains(Hideset *hs, char *name) {
+    for (; hs && hs->name <= name; hs = hs->next)
+        if (hs->name == name)
             return true;
     return false;
 }
 
 static Hideset *hideset_intersection(Hideset *hs1, Hideset *hs2) { // intersection: a group of items that belong to two different sets.
-    Hideset head = {};
-    Hideset *cur = &head;
-
-    for (; hs1; hs1 = hs1->next)
-        if (hideset_contains(hs2, hs1->name, strlen(hs1->name)))
-            cur = cur->next = new_hideset(hs1->name);
-    return head.next;
+    if (!hs1 || !hs2 || hs1 == hs2)
+        return hs1 == hs2 ? hs1 : NULL;
+
+    HidesetOp *op = find_hideset_op(&hideset_intersections, hs1, hs2);
+    if (op)
+        return op->result;
+
+    Hideset *hs;
+    if (hs1->name == hs2->name)
+        hs = cons_hideset(hs1->name, hideset_intersection(hs1->next, hs2->next));
+    else if (hs1->name < hs2->name)
+        hs = hideset_intersection(hs1->next, hs2);
+    else
+        hs = hideset_intersection(hs1, hs2->next);
+    return memo_hideset_op(&hideset_intersections, hs1, hs2, hs);
 }
 
-static Token *add_hideset(Token *tok, Hideset *hs) {
+// Returns a copy of the tokens of `tok` up to EOF with `hs` added
+// to their hidesets, followed by `next`. Macro bodies are shared by
+// all expansions, so this is the only place their tokens are copied.
+static Token *add_hideset(Token *tok, Hideset *hs, Token *next) {
     Token head = {};
     Token *cur = &head;
 
-    for (; tok; tok = tok->next) {
+    for (; tok->kind != TK_EOF; tok = tok->next) {
         Token *t = copy_token(tok);
         t->hideset = hideset_union(t->hideset, hs);
         cur = cur->next = t;
     }
+    cur->next = next;
     return head.next;
 }
 
-// Append tok2 to the end of tok1.
+// Same as add_hideset but updates `tok` in place. `tok` must be a
+// NULL-terminated list that is not referenced from anywhere else.
+static Token *add_hideset_in_place(Token *tok, Hideset *hs, Token *next) {
+    if (!tok)
+        return next;
+
+    Token *t = tok;
+    for (;; t = t->next) {
+        t->hideset = hideset_union(t->hideset, hs);
+        if (!t->next)
+            break;
+    }
+    t->next = next;
+    return tok;
+}
+
+// Append tok2 to the end of tok1. tok1 is modified in place, so it
+// must be a fresh list such as the one returned by tokenize().
 static Token *append(Token *tok1, Token *tok2) {
     if (!tok1 || tok1->kind == TK_EOF)
         return tok2;
 
-    Token head = {};
-    Token *cur = &head;
-
-    for (; tok1 && tok1->kind != TK_EOF; tok1 = tok1->next)
-        cur = cur->next = copy_token(tok1);
-    cur->next = tok2;
-    return head.next;
+    Token *t = tok1;
+    while (t->next && t->next->kind != TK_EOF)
+        t = t->next;
+    t->next = tok2;
+    return tok1;
 }
 
 static Token *skip_cond_incl2(Token *tok) {
     while (tok->kind != TK_EOF) {
         if (is_hash(tok) &&
-            (equal(tok->next, "if") || equal(tok->next, "ifdef") ||
-             equal(tok->next, "ifndef"))) {
+            (tok->next->id == KW_IF || tok->next->id == PP_IFDEF ||
+             tok->next->id == PP_IFNDEF)) {
             tok = skip_cond_incl2(tok->next->next);
             continue;
         }
-        if (is_hash(tok) && equal(tok->next, "endif"))
+        if (is_hash(tok) && tok->next->id == PP_ENDIF)
             return tok->next->next;
         tok = tok->next;
     }
@@ -179,15 +304,15 @@ static Token *skip_cond_incl2(Token *tok) {
 static Token *skip_cond_incl(Token *tok) {
     while (tok->kind != TK_EOF) {
         if (is_hash(tok) &&
-            (equal(tok->next, "if") || equal(tok->next, "ifdef") ||
-             equal(tok->next, "ifndef"))) {
+            (tok->next->id == KW_IF || tok->next->id == PP_IFDEF ||
+             tok->next->id == PP_IFNDEF)) {
             tok = skip_cond_incl2(tok->next->next);
             continue;
         }
 
         if (is_hash(tok) &&
-            (equal(tok->next, "elif") || equal(tok->next, "else") ||
-             equal(tok->next, "endif")))
+            (tok->next->id == PP_ELIF || tok->next->id == KW_ELSE ||
+             tok->next->id == PP_ENDIF))
             break;
         tok = tok->next;
     }
@@ -216,20 +341,28 @@ static char *quote_string(char *str) {
     return buf;
 }
 
+// Tokenizes a synthesized buffer as if it came from the same file
+// as `tmpl`.
+static Token *tokenize_as(char *buf, Token *tmpl) {
+    SourceFile *file = get_source_file(tmpl);
+    return tokenize(new_source_file(file->name, file->file_no, buf));
+}
+
 static Token *new_str_token(char *str, Token *tmpl) { // tmpl: template
     char *buf = quote_string(str);
-    return tokenize(tmpl->filename, tmpl->file_no, buf);
+    return tokenize_as(buf, tmpl);
 }
 
 // Copy all tokens until the next newline, terminate them with
 // an EOF token and then returns them. This function is used to
-// create a new list of tokens for `#if` arguments.
-static Token *copy_line(Token **rest, Token *tok) {
+// create a new list of tokens for `#if` arguments. `kind` tells
+// -fmem-report what the copies are for.
+static Token *copy_line(Token **rest, Token *tok, MemKind kind) {
     Token head = {};
     Token *cur = &head;
 
     for (; !tok->at_bol; tok = tok->next)
-        cur = cur->next = copy_token(tok);
+        cur = cur->next = copy_token2(tok, kind);
 
     cur->next = new_eof(tok);
     *rest = tok;
@@ -239,11 +372,11 @@ static Token *copy_line(Token **rest, Token *tok) {
 static Token *new_num_token(int val, Token *tmpl) {
     char *buf = malloc(20);
     sprintf(buf, "%d\n", val);
-    return tokenize(tmpl->filename, tmpl->file_no, buf);
+    return tokenize_as(buf, tmpl);
 }
 
 static Token *read_const_expr(Token **rest, Token *tok) {
-    tok = copy_line(rest, tok);
+    tok = copy_line(rest, tok, MEM_TOKEN_COPY);
 
     Token head = {};
     Token *cur = &head;
@@ -251,7 +384,7 @@ static Token *read_const_expr(Token **rest, Token *tok) {
     while (tok->kind != TK_EOF) {
         // "defined(foo)" or "defined foo" becomes "1" if macro "foo"
         // is defined. Otherwise "0".
-        if (equal(tok, "defined")) {
+        if (tok->id == PP_DEFINED) {
             Token *start = tok;
             bool has_paren = consume(&tok, tok->next, "(");
 
@@ -312,23 +445,37 @@ static CondIncl *push_cond_incl(Token *tok, bool included) {
     return ci;
 }
 
+static bool macro_filter_test(char *name, int len) {
+    unsigned char c = name[0];
+    return macro_filter[len & 63][(c >> 3) & 15] & (1 << (c & 7));
+}
+
+static void macro_filter_set(char *name, int len) {
+    unsigned char c = name[0];
+    macro_filter[len & 63][(c >> 3) & 15] |= 1 << (c & 7);
+}
+
 static Macro *find_macro(Token *tok) {
     if (tok->kind != TK_IDENT)
         return NULL;
 
-    for (Macro *m = macros; m; m = m->next)
-        if (strlen(m->name) == tok->len && !strncmp(m->name, tok->loc, tok->len))
-            return m->deleted ? NULL : m;
-    return NULL;
+    if (!macro_filter_test(tok->loc, tok->len))
+        return NULL;
+
+    Macro *m = hashmap_get3(&macros, tok->sym, tok->len, tok->hash);
+    if (m && m->deleted)
+        return NULL;
+    return m;
 }
 
 static Macro *add_macro(char *name, bool is_objlike, Token *body) {
     Macro *m = calloc(1, sizeof(Macro));
-    m->next = macros;
-    m->name = name;
+    mem_count(MEM_MACRO, sizeof(Macro));
+    m->name = intern(name, strlen(name));
     m->is_objlike = is_objlike;
     m->body = body;
-    macros = m;
+    macro_filter_set(m->name, strlen(m->name));
+    hashmap_put(&macros, m->name, m);
     return m;
 }
 
@@ -336,11 +483,11 @@ static MacroParam *read_macro_params(Token **rest, Token *tok, bool *is_variadic
     MacroParam head = {};
     MacroParam *cur = &head;
 
-    while (!equal(tok, ")")) {
+    while (tok->id != P_RPAREN) {
         if (cur != &head)
             tok = skip(tok, ",");
 
-        if (equal(tok, "...")) {
+        if (tok->id == P_ELLIPSIS) {
             *is_variadic = true;
             tok = tok->next;
             skip(tok, ")"); // `...` must be last of params, and then `)`
@@ -350,7 +497,8 @@ static MacroParam *read_macro_params(Token **rest, Token *tok, bool *is_variadic
         if (tok->kind != TK_IDENT)
             error_tok(tok, "expected an identifier");
         MacroParam *m = calloc(1, sizeof(MacroParam));
-        m->name = strndup(tok->loc, tok->len);
+        mem_count(MEM_MACRO, sizeof(MacroParam));
+        m->name = tok->sym;
         cur = cur->next = m;
         tok = tok->next;
     }
@@ -362,48 +510,47 @@ static MacroParam *read_macro_params(Token **rest, Token *tok, bool *is_variadic
 static void read_macro_definition(Token **rest, Token *tok) {
     if (tok->kind != TK_IDENT)
         error_tok(tok, "macro name must be an identifier");
-    char *name = strndup(tok->loc, tok->len);
+    char *name = tok->sym;
     tok = tok->next;
 
-    if (!tok->has_space && equal(tok, "(")) {
+    if (!tok->has_space && tok->id == P_LPAREN) {
         // Function-like macro
         bool is_variadic = false;
         MacroParam *params = read_macro_params(&tok, tok->next, &is_variadic);
 
-        Macro *m = add_macro(name, false, copy_line(rest, tok));
+        Macro *m = add_macro(name, false, copy_line(rest, tok, MEM_MACRO));
         m->params = params;
         m->is_variadic = is_variadic;
     } else {
         // Object-like macro
-        add_macro(name, true, copy_line(rest, tok));
+        add_macro(name, true, copy_line(rest, tok, MEM_MACRO));
     }
 }
 // Read one token and set to one macro argument. But if `read_rest` is true, keep reading multiple tokens until read last `)` and all tokens set to one argument.
 static MacroArg *read_macro_arg_one(Token **rest, Token *tok, bool read_rest) {
-    Token head = {};
-    Token *cur = &head;
+    Token *start = tok;
     int level = 0;
 
     for (;;) {
-        if (level == 0 && equal(tok, ")"))
+        if (level == 0 && tok->id == P_RPAREN)
             break;
-        if (level == 0 && !read_rest && equal(tok, ","))
+        if (level == 0 && !read_rest && tok->id == P_COMMA)
             break;
 
         if (tok->kind == TK_EOF)
             error_tok(tok, "premature end of input");
 
-        if (equal(tok, "("))
+        if (tok->id == P_LPAREN)
             level++;
-        else if (equal(tok, ")"))
+        else if (tok->id == P_RPAREN)
             level--;
 
-        cur = cur->next = copy_token(tok);
         tok = tok->next;
     }
 
     MacroArg *arg = calloc(1, sizeof(MacroArg));
-    arg->tok = head.next;
+    arg->tok = start;
+    arg->end = tok;
     *rest = tok;
     return arg;
 }
@@ -428,7 +575,7 @@ read_macro_args(Token **rest, Token *tok, MacroParam *params, bool is_variadic)
         if (pp != params) // always true?
             tok = skip(tok, ",");
         cur = cur->next = read_macro_arg_one(&tok, tok, true);
-        cur->name = "__VA_ARGS__";
+        cur->name = intern("__VA_ARGS__", 11);
     } else if (pp) { // always false?
         error_tok(start, "too many arguments");
     }
@@ -438,15 +585,10 @@ read_macro_args(Token **rest, Token *tok, MacroParam *params, bool is_variadic)
     return head.next;
 }
 
-// Macro arguments can be empty. For example, the second argument
-// of foo(a,,c) is the empty list of tokens. The following special
-// pointer represents the empty list.
-static Token *EMPTY = (Token *)-1;
-
-static Token *find_arg(MacroArg *args, Token *tok) {
+static MacroArg *find_arg(MacroArg *args, Token *tok) {
     for (MacroArg *ap = args; ap; ap = ap->next)
-        if (tok->len == strlen(ap->name) && !strncmp(tok->loc, ap->name, tok->len))
-            return ap->tok ? ap->tok : EMPTY;
+        if (tok->sym == ap->name)
+            return ap;
     return NULL;
 }
 
@@ -476,11 +618,11 @@ static char *join_tokens(Token *tok, Token *end) {
 
 // Concatenates all tokens in `arg` and returns a new string token.
 // This function is used for the stringizing operator (#).
-static Token *stringize(Token *hash, Token *arg) {
+static Token *stringize(Token *hash, MacroArg *arg) {
     // Create a new string token. We need to set some value to its
     // source location for error reporting function, so we use a macro
     // name token as a template.
-    char *s = join_tokens(arg, NULL);
+    char *s = join_tokens(arg->tok, arg->end);
     return new_str_token(s, hash);
 }
 
@@ -491,19 +633,21 @@ static Token *paste(Token *lhs, Token *rhs) {
     sprintf(buf, "%.*s%.*s", lhs->len, lhs->loc, rhs->len, rhs->loc); // sprintf write terminate null byte '\0'
 
     // Tokenize the resulting string.
-    Token *tok = tokenize(lhs->filename, lhs->file_no, buf);
+    Token *tok = tokenize_as(buf, lhs);
     if (tok->next->kind != TK_EOF)
         error_tok(lhs, "pasting forms '%s', an invalid token", buf);
     return tok;
 }
 
 // Replace func-like macro parameters with given arguments.
+// Returns a fresh copy of the macro body `tok` with its parameters
+// replaced by the actual arguments. The list is NULL-terminated.
 static Token *subst(Token *tok, MacroArg *args) { // subst: substitute
     Token head = {};
     Token *cur = &head;
 
     while (tok->kind != TK_EOF) {
-        Token *arg = find_arg(args, tok);
+        MacroArg *arg = find_arg(args, tok);
 
         // If the current token is a macro parameter, replaces
         // it with actuals.
@@ -511,22 +655,21 @@ static Token *subst(Token *tok, MacroArg *args) { // subst: substitute
             tok = tok->next;
 
             // x##y becomes y if x is the empty argument list.
-            if (arg == EMPTY && equal(tok, "##")) {
+            if (arg->tok == arg->end && tok->id == P_HASHHASH) {
                 tok = tok->next;
                 continue;
             }
 
-            if (arg != EMPTY)
-                for (Token *t = arg; t; t = t->next)
-                    cur = cur->next = copy_token(t);
+            for (Token *t = arg->tok; t != arg->end; t = t->next)
+                cur = cur->next = copy_token(t);
             continue;
         }
 
         // Replace x##y with xy. LHS has already been macro-expanded and
         // added to `cur`.
-        if (equal(tok, "##")) {
+        if (tok->id == P_HASHHASH) {
             tok = tok->next;
-            Token *rhs = find_arg(args, tok);
+            MacroArg *rhs = find_arg(args, tok);
 
             if (!rhs) {
                 *cur = *paste(cur, tok);
@@ -537,18 +680,18 @@ static Token *subst(Token *tok, MacroArg *args) { // subst: substitute
             tok = tok->next;
 
             // x##y becomes x if y is the empty argument list.
-            if (rhs == EMPTY)
+            if (rhs->tok == rhs->end)
                 continue;
             
-            *cur = *paste(cur, rhs);
-            for (Token *t = rhs->next; t; t = t->next)
+            *cur = *paste(cur, rhs->tok);
+            for (Token *t = rhs->tok->next; t != rhs->end; t = t->next)
                 cur = cur->next = copy_token(t);
             continue;
         }
 
         // "#" followed by a parameter is replaced with stringized actuals.
-        if (equal(tok, "#")) {
-            Token *arg = find_arg(args, tok->next);
+        if (tok->id == P_HASH) {
+            MacroArg *arg = find_arg(args, tok->next);
             if (arg) {
                 cur = cur->next = stringize(tok, arg);
                 tok = tok->next->next;
@@ -562,11 +705,12 @@ static Token *subst(Token *tok, MacroArg *args) { // subst: substitute
         continue;
     }
 
+    cur->next = NULL;
     return head.next;
 }
 
 static bool expand_macro(Token **rest, Token *tok) {
-    if (hideset_contains(tok->hideset, tok->loc, tok->len))
+    if (hideset_contains(tok->hideset, tok->sym))
         return false;
 
     Macro *m = find_macro(tok);
@@ -575,8 +719,10 @@ static bool expand_macro(Token **rest, Token *tok) {
 
     // Object-like macro application
     if (m->is_objlike) {
+        stat_macro_expansions++;
+
         if (m == file_macro) {
-            *rest = new_str_token(tok->filename, tok);
+            *rest = new_str_token(get_source_file(tok)->name, tok);
             (*rest)->next = tok->next;
             return true;
         }
@@ -588,17 +734,17 @@ static bool expand_macro(Token **rest, Token *tok) {
         }
         
         Hideset *hs = hideset_union(tok->hideset, new_hideset(m->name));
-        Token *body = add_hideset(m->body, hs);
-        *rest = append(body, tok->next);
+        *rest = add_hideset(m->body, hs, tok->next);
         return true;
     }
 
     // If a funclike macro token is not followed by an argument list,
     // treat it as a normal identifier.
-    if (!equal(tok->next, "("))
+    if (tok->next->id != P_LPAREN)
         return false;
     
     // Function-like macro application
+    stat_macro_expansions++;
     Token *macro_token = tok;
     MacroArg *args = read_macro_args(&tok, tok, m->params, m->is_variadic);
     Token *rparen = tok; // right parenthsis
@@ -612,8 +758,7 @@ static bool expand_macro(Token **rest, Token *tok) {
     hs = hideset_union(hs, new_hideset(m->name));
 
     Token *body = subst(m->body, args);
-    body = add_hideset(body, hs);
-    *rest = append(body, tok->next);
+    *rest = add_hideset_in_place(body, hs, tok->next);
     return true;
 }
 
@@ -630,6 +775,17 @@ static bool file_exists(char *path) {
     return !stat(path, &st);
 }
 
+// Returns a key that identifies a file no matter which path it is
+// reached by, or NULL if it doesn't exist.
+static char *file_id(char *path) {
+    struct stat st;
+    if (stat(path, &st))
+        return NULL;
+    char *buf = malloc(40);
+    sprintf(buf, "%lx:%lx", (unsigned long)st.st_dev, (unsigned long)st.st_ino);
+    return buf;
+}
+
 static char *search_include_paths(char *filename, Token *start) {
     // Search a file from the include paths.
     for (char **p = include_paths; *p; p++) {
@@ -640,6 +796,24 @@ static char *search_include_paths(char *filename, Token *start) {
     error_tok(start, "'%s': file not found", filename);
 }
 
+// Resolves an #include filename to a path. Quoted names are looked
+// up in the current directory first. Results are cached by spelling,
+// so a header is searched for only once.
+static char *resolve_include(char *filename, bool quoted, Token *start) {
+    static HashMap cache[2];
+
+    char *path = hashmap_get(&cache[quoted], filename);
+    if (path)
+        return path;
+
+    if (quoted && file_exists(filename))
+        path = filename;
+    else
+        path = search_include_paths(filename, start);
+    hashmap_put(&cache[quoted], filename, path);
+    return path;
+}
+
 // Read an #include argument.
 static char *read_include_path(Token **rest, Token *tok) {
     // Pattern 1: #include "foo.h"
@@ -652,39 +826,106 @@ static char *read_include_path(Token **rest, Token *tok) {
         Token *start = tok;
         char *filename = strndup(tok->loc + 1, tok->len - 2);
         *rest = skip_line(tok->next);
-
-        if (file_exists(filename))
-            return filename;
-        return search_include_paths(filename, start);
+        return resolve_include(filename, true, start);
     }
 
     // Pattern 2: #include <foo.h>
-    if (equal(tok, "<")) {
+    if (tok->id == P_LT) {
         // Reconstruct a filename from a sequence of tokens between
         // "<" and ">".
         Token *start = tok;
         
         // Find closing ">".
-        for (; !equal(tok, ">"); tok = tok->next)
+        for (; tok->id != P_GT; tok = tok->next)
             if (tok->kind == TK_EOF)
                 error_tok(tok, "expected '>'");
         
         char *filename = join_tokens(start->next, tok); // this `tok` is `>`
         *rest = skip_line(tok->next);
-        return search_include_paths(filename, start);
+        return resolve_include(filename, false, start);
     }
 
     // Pattern 3: #include FOO
     // In this case FOO must be macro-expanded to either
     // a single string token or a sequence of "<" ... ">".
     if (tok->kind == TK_IDENT) {
-        Token *tok2 = preprocess(copy_line(rest, tok));
+        Token *tok2 = preprocess(copy_line(rest, tok, MEM_TOKEN_COPY));
         return read_include_path(&tok2, tok2);
     }
 
     error_tok(tok, "expected a filename");
 }
 
+// Returns the guard macro name token if a given file is entirely
+// enclosed in `#ifndef X`, `#define X` ... `#endif`.
+static Token *detect_include_guard(Token *tok) {
+    // Detect the first two lines.
+    if (!is_hash(tok) || tok->next->id != PP_IFNDEF)
+        return NULL;
+    tok = tok->next->next;
+    if (tok->kind != TK_IDENT)
+        return NULL;
+
+    Token *guard = tok;
+    tok = tok->next;
+    if (!is_hash(tok) || tok->next->id != PP_DEFINE ||
+        tok->next->next->sym != guard->sym)
+        return NULL;
+
+    // The `#endif` that closes the first `#ifndef` must end the file.
+    while (tok->kind != TK_EOF) {
+        if (!is_hash(tok)) {
+            tok = tok->next;
+            continue;
+        }
+
+        TokenId id = tok->next->id;
+        if (id == KW_IF || id == PP_IFDEF || id == PP_IFNDEF) {
+            tok = skip_cond_incl2(tok->next->next);
+            continue;
+        }
+        if (id == PP_ENDIF)
+            return tok->next->next->kind == TK_EOF ? guard : NULL;
+        if (id == PP_ELIF || id == KW_ELSE)
+            return NULL;
+        tok = tok->next;
+    }
+    return NULL;
+}
+
+// Inserts the contents of a given file in front of `tok`. `start`
+// is the #include token used for error reporting.
+static Token *include_file(Token *tok, char *path, Token *start) {
+    // Check for "#pragma once".
+    if (pragma_once.used && hashmap_get(&pragma_once, file_id(path)))
+        return tok;
+
+    // If the file was guarded by the usual #ifndef ... #endif
+    // pattern and the guard is still defined, we can skip the file
+    // without opening it.
+    Token *guard = hashmap_get(&include_guards, path);
+    if (guard && find_macro(guard))
+        return tok;
+
+    timer_start("include", path);
+    Token *tok2 = hashmap_get(&file_tokens, path);
+    if (tok2) {
+        tok2 = copy_file_tokens(tok2);
+    } else {
+        tok2 = tokenize_file(path);
+        if (!tok2)
+            error_tok(start, "%s", strerror(errno));
+
+        guard = detect_include_guard(tok2);
+        if (guard)
+            hashmap_put(&include_guards, path, guard);
+        else
+            hashmap_put(&file_tokens, path, copy_tokens(tok2));
+    }
+    timer_stop();
+    return append(tok2, tok);
+}
+
 // Visit all tokens in `tok` while evaluating preprocessing
 // macros and directives.
 static Token *preprocess2(Token *tok) {
@@ -706,25 +947,23 @@ static Token *preprocess2(Token *tok) {
         Token *start = tok;
         tok = tok->next;
 
-        if (equal(tok, "include")) {
+        if (tok->id == PP_INCLUDE) {
+            Token *start = tok;
             char *path = read_include_path(&tok, tok->next);
-            Token *tok2 = tokenize_file(path);
-            if (!tok2)
-                error_tok(tok, "%s", strerror(errno));
-            tok = append(tok2, tok);
+            tok = include_file(tok, path, start);
             continue;
         }
 
-        if (equal(tok, "define")) {
+        if (tok->id == PP_DEFINE) {
             read_macro_definition(&tok, tok->next);
             continue;
         }
 
-        if (equal(tok, "undef")) {
+        if (tok->id == PP_UNDEF) {
             tok = tok->next;
             if (tok->kind != TK_IDENT)
                 error_tok(tok, "macro name must be an identifier");
-            char *name = strndup(tok->loc, tok->len);
+            char *name = tok->sym;
             tok = skip_line(tok->next);
 
             Macro *m = add_macro(name, true, NULL);
@@ -732,7 +971,7 @@ static Token *preprocess2(Token *tok) {
             continue;
         }
 
-        if (equal(tok, "if")) {
+        if (tok->id == KW_IF) {
             long val = eval_const_expr(&tok, tok->next);
             push_cond_incl(start, val);
             if (!val)
@@ -740,7 +979,7 @@ static Token *preprocess2(Token *tok) {
             continue;
         }
         
-        if (equal(tok, "ifdef")) {
+        if (tok->id == PP_IFDEF) {
             bool defined = find_macro(tok->next);
             push_cond_incl(tok, defined);
             tok = skip_line(tok->next->next);
@@ -749,7 +988,7 @@ static Token *preprocess2(Token *tok) {
             continue;
         }
 
-        if (equal(tok, "ifndef")) {
+        if (tok->id == PP_IFNDEF) {
             bool defined = find_macro(tok->next);
             push_cond_incl(tok, !defined);
             tok = skip_line(tok->next->next);
@@ -758,7 +997,7 @@ static Token *preprocess2(Token *tok) {
             continue;
         }
 
-        if (equal(tok, "elif")) {
+        if (tok->id == PP_ELIF) {
             if (!cond_incl || cond_incl->ctx == IN_ELSE)
                 error_tok(start, "stray #elif");
             cond_incl->ctx = IN_ELIF;
@@ -770,7 +1009,7 @@ static Token *preprocess2(Token *tok) {
             continue;
         }
 
-        if (equal(tok, "else")) {
+        if (tok->id == KW_ELSE) {
             if (!cond_incl || cond_incl->ctx == IN_ELSE)
                 error_tok(start, "stray #else");
             cond_incl->ctx = IN_ELSE;
@@ -781,7 +1020,7 @@ static Token *preprocess2(Token *tok) {
             continue;
         }
 
-        if (equal(tok, "endif")) {
+        if (tok->id == PP_ENDIF) {
             if (!cond_incl)
                 error_tok(start, "stray #endif");
             cond_incl = cond_incl->next;
@@ -789,7 +1028,26 @@ static Token *preprocess2(Token *tok) {
             continue;
         }
 
-        if (equal(tok, "error"))
+        if (tok->id == PP_PRAGMA) {
+            Token *start = tok;
+            tok = tok->next;
+            if (tok->id == PP_ONCE && !tok->at_bol) {
+                char *id = file_id(get_source_file(tok)->name);
+                if (id)
+                    hashmap_put(&pragma_once, id, id);
+            } else if (equal(tok, "pack") && !tok->at_bol) {
+                // Ignoring this would silently change struct layouts.
+                error_tok(tok, "unsupported pragma");
+            } else {
+                warn_tok(start, "unknown pragma ignored");
+            }
+
+            while (!tok->at_bol)
+                tok = tok->next;
+            continue;
+        }
+
+        if (tok->id == PP_ERROR)
             error_tok(tok, "");
 
         // `#`-only line is legal. It's called a null directive.
@@ -804,10 +1062,39 @@ static Token *preprocess2(Token *tok) {
 }
 
 void define_macro(char *name, char *buf) {
-    Token *tok = tokenize("(internal)", 1, buf);
+    Token *tok = tokenize(new_source_file("(internal)", 1, buf));
     add_macro(name, true, tok);
 }
 
+// -D and -U options in command line order, one per line. A
+// precompiled header is only used with the options it was built with.
+static char *cmdline_macros = "";
+
+static void add_cmdline_macro(char *opt) {
+    char *s = malloc(strlen(cmdline_macros) + strlen(opt) + 2);
+    sprintf(s, "%s%s\n", cmdline_macros, opt);
+    cmdline_macros = s;
+}
+
+void cmdline_define(char *name, char *buf) {
+    Token *tok = tokenize(new_source_file("(internal)", 1, buf));
+    add_macro(name, true, tok)->from_cmdline = true;
+
+    char *opt = malloc(strlen(name) + strlen(buf) + 4);
+    sprintf(opt, "-D%s=%s", name, buf);
+    add_cmdline_macro(opt);
+}
+
+void cmdline_undef(char *name) {
+    Macro *m = add_macro(name, true, NULL);
+    m->deleted = true;
+    m->from_cmdline = true;
+
+    char *opt = malloc(strlen(name) + 3);
+    sprintf(opt, "-U%s", name);
+    add_cmdline_macro(opt);
+}
+
 void init_macros(void) {
     // Define predefined macros
     define_macro("__zcc__", "1");
@@ -861,7 +1148,7 @@ void init_macros(void) {
 static Token *join_strings(Token *t1, Token *t2) { // t1->len = 5, t2->len = 5
     char *buf = malloc(t1->len + t2->len - 1); // sizeof (t1->len + t2->len - 1) = 9
     sprintf(buf, "%.*s%.*s", t1->len - 1, t1->loc, t2->len - 1, t2->loc + 1); //t1->loc = ["]foo", (t2->loc + 1) = "[b]ar"
-    return tokenize(t1->filename, t1->file_no, buf); // buf = '"' 'f' 'o' 'o' 'b' 'a' 'r' '"' '\0'
+    return tokenize_as(buf, t1); // buf = '"' 'f' 'o' 'o' 'b' 'a' 'r' '"' '\0'
 }
 
 // Concatenate adjacent string literals into a single string literal
@@ -883,7 +1170,386 @@ Token *preprocess(Token *tok) {
     tok = preprocess2(tok);
     if (cond_incl)
         error_tok(cond_incl->tok, "unterminated conditional directive");
+    tok = append(pch_tokens, tok);
     convert_pp_tokens(tok);
     join_adjacent_string_literals(tok);
     return tok;
 }
+
+//
+// Precompiled headers
+//
+// A precompiled header is an image of the preprocessor state after
+// a header has been read: the macro table, the include guards and
+// the header's preprocessed tokens. Loading it restores that state
+// without opening, tokenizing or macro-expanding any of the files
+// the header included.
+//
+// The image consists of a header followed by a string blob and
+// arrays of fixed-size records that refer to the blob by offset.
+// Token spellings are laid out in the blob like `-E` output so that
+// error messages for loaded tokens still show a meaningful line.
+//
+// The image also records the size and modification time of every
+// file that was read, and the -D, -U and -I options it was built
+// with. It is rejected if any of them differ.
+//
+
+#define PCH_MAGIC "ZCCPCH2\n"
+
+typedef struct {
+    char magic[8];
+    int nfiles;
+    int ntokens;
+    int nliterals;
+    int nmacros;
+    int nparams;
+    int nguards;
+    int nonce;
+    int ndeps;
+    int options; // Offset of the option string in the blob
+    int blob_size;
+} PchHeader;
+
+typedef struct {
+    long size;
+    long mtime; // In nanoseconds
+    int path;
+} PchDep;
+
+typedef struct {
+    int name;
+    int file_no;
+} PchFile;
+
+typedef struct {
+    int loc;
+    int len;
+    int line_no;
+    int file;
+    int lit;  // Index of the literal or -1
+    unsigned char kind;
+    bool at_bol;
+    bool has_space;
+} PchToken;
+
+typedef struct {
+    long val;
+    int contents;
+    int cont_len;
+} PchLiteral;
+
+typedef struct {
+    int name;
+    int body;   // Index of the first body token; the body ends with EOF
+    int params; // Index of the first parameter name
+    int nparams;
+    bool is_objlike;
+    bool is_variadic;
+    bool deleted;
+} PchMacro;
+
+typedef struct {
+    int path;
+    int tok; // Index of the guard macro name token
+} PchGuard;
+
+typedef struct {
+    char *data;
+    int len;
+    int cap;
+} PchBuf;
+
+static int pch_add(PchBuf *buf, void *data, int len) {
+    if (buf->len + len > buf->cap) {
+        buf->cap = (buf->cap + len) * 2;
+        buf->data = realloc(buf->data, buf->cap);
+    }
+    int off = buf->len;
+    memcpy(buf->data + off, data, len);
+    buf->len += len;
+    return off;
+}
+
+static int pch_add_str(PchBuf *blob, char *s) {
+    return pch_add(blob, s, strlen(s) + 1);
+}
+
+typedef struct {
+    PchBuf blob;
+    PchBuf files;
+    PchBuf tokens;
+    PchBuf literals;
+    PchBuf macros;
+    PchBuf params;
+    PchBuf guards;
+    PchBuf once;
+    PchBuf deps;
+} PchWriter;
+
+// Returns the image file index for a given file number.
+static int pch_file(PchWriter *w, SourceFile *file) {
+    PchFile *files = (PchFile *)w->files.data;
+    int n = w->files.len / sizeof(PchFile);
+    for (int i = 0; i < n; i++)
+        if (files[i].file_no == file->file_no)
+            return i;
+
+    PchFile f = {pch_add_str(&w->blob, file->name), file->file_no};
+    pch_add(&w->files, &f, sizeof(f));
+    return n;
+}
+
+// Writes a list of tokens up to and including EOF (or up to NULL)
+// and returns the index of the first one.
+static int pch_write_tokens(PchWriter *w, Token *tok) {
+    int first = w->tokens.len / sizeof(PchToken);
+
+    for (; tok; tok = tok->next) {
+        if (tok->at_bol)
+            pch_add(&w->blob, "\n", 1);
+        else if (tok->has_space)
+            pch_add(&w->blob, " ", 1);
+
+        PchToken t = {};
+        t.loc = pch_add(&w->blob, tok->loc, tok->len);
+        t.len = tok->len;
+        t.line_no = tok->line_no;
+        t.file = pch_file(w, get_source_file(tok));
+        t.lit = -1;
+        t.kind = tok->kind;
+        t.at_bol = tok->at_bol;
+        t.has_space = tok->has_space;
+
+        if (tok->kind == TK_STR || tok->kind == TK_NUM) {
+            PchLiteral lit = {};
+            lit.val = tok->lit->val;
+            if (tok->kind == TK_STR) {
+                lit.contents = pch_add(&w->blob, tok->lit->contents, tok->lit->cont_len);
+                lit.cont_len = tok->lit->cont_len;
+            }
+            t.lit = w->literals.len / sizeof(PchLiteral);
+            pch_add(&w->literals, &lit, sizeof(lit));
+        }
+
+        pch_add(&w->tokens, &t, sizeof(t));
+        if (tok->kind == TK_EOF)
+            break;
+    }
+    return first;
+}
+
+// Returns the options that affect the contents of an image.
+static char *pch_options(void) {
+    int len = strlen(cmdline_macros);
+    for (int i = 0; include_paths[i]; i++)
+        len += strlen(include_paths[i]) + 3;
+
+    char *buf = malloc(len + 1);
+    char *p = buf + sprintf(buf, "%s", cmdline_macros);
+    for (int i = 0; include_paths[i]; i++)
+        p += sprintf(p, "-I%s\n", include_paths[i]);
+    return buf;
+}
+
+static long mtime_ns(struct stat *st) {
+    return st->st_mtim.tv_sec * 1000000000L + st->st_mtim.tv_nsec;
+}
+
+// Preprocesses a header and writes the resulting state to stdout.
+void write_pch(Token *tok) {
+    // Record the header's own guard so that an #include of it from
+    // the main file is skipped, too.
+    Token *guard = detect_include_guard(tok);
+    if (guard)
+        hashmap_put(&include_guards, get_source_file(tok)->name, guard);
+
+    tok = preprocess2(tok);
+    if (cond_incl)
+        error_tok(cond_incl->tok, "unterminated conditional directive");
+
+    PchWriter w = {};
+    pch_write_tokens(&w, tok);
+
+    for (int i = 0; i < macros.capacity; i++) {
+        Macro *m = macros.buckets[i].val;
+        if (!m || m == file_macro || m == line_macro)
+            continue;
+
+        PchMacro pm = {};
+        pm.name = pch_add_str(&w.blob, m->name);
+        pm.body = m->body ? pch_write_tokens(&w, m->body) : -1;
+        pm.params = w.params.len / sizeof(int);
+        for (MacroParam *pp = m->params; pp; pp = pp->next) {
+            int name = pch_add_str(&w.blob, pp->name);
+            pch_add(&w.params, &name, sizeof(name));
+            pm.nparams++;
+        }
+        pm.is_objlike = m->is_objlike;
+        pm.is_variadic = m->is_variadic;
+        pm.deleted = m->deleted;
+        pch_add(&w.macros, &pm, sizeof(pm));
+    }
+
+    for (int i = 0; i < include_guards.capacity; i++) {
+        HashEntry *ent = &include_guards.buckets[i];
+        if (!ent->val)
+            continue;
+        Token *guard = ent->val;
+        PchGuard g = {pch_add_str(&w.blob, ent->key), w.tokens.len / sizeof(PchToken)};
+        Token t = *guard;
+        t.next = NULL;
+        pch_write_tokens(&w, &t);
+        pch_add(&w.guards, &g, sizeof(g));
+    }
+
+    for (int i = 0; i < pragma_once.capacity; i++) {
+        if (!pragma_once.buckets[i].val)
+            continue;
+        int id = pch_add_str(&w.blob, pragma_once.buckets[i].val);
+        pch_add(&w.once, &id, sizeof(id));
+    }
+
+    // Every file that was read, including headers that were skipped
+    // or produced no tokens
+    HashMap seen = {};
+    int nfiles;
+    SourceFile **files = get_source_files(&nfiles);
+    for (int i = 0; i < nfiles; i++) {
+        char *name = files[i]->name;
+        struct stat st;
+        if (hashmap_get(&seen, name) || stat(name, &st) != 0)
+            continue;
+        hashmap_put(&seen, name, name);
+        PchDep dep = {st.st_size, mtime_ns(&st), pch_add_str(&w.blob, name)};
+        pch_add(&w.deps, &dep, sizeof(dep));
+    }
+
+    PchHeader hdr = {PCH_MAGIC};
+    hdr.nfiles = w.files.len / sizeof(PchFile);
+    hdr.ntokens = w.tokens.len / sizeof(PchToken);
+    hdr.nliterals = w.literals.len / sizeof(PchLiteral);
+    hdr.nmacros = w.macros.len / sizeof(PchMacro);
+    hdr.nparams = w.params.len / sizeof(int);
+    hdr.nguards = w.guards.len / sizeof(PchGuard);
+    hdr.nonce = w.once.len / sizeof(int);
+    hdr.ndeps = w.deps.len / sizeof(PchDep);
+    hdr.options = pch_add_str(&w.blob, pch_options());
+    hdr.blob_size = w.blob.len;
+
+    fwrite(&hdr, sizeof(hdr), 1, stdout);
+    PchBuf *bufs[] = {&w.deps, &w.files, &w.tokens, &w.literals, &w.macros,
+                      &w.params, &w.guards, &w.once, &w.blob};
+    for (int i = 0; i < sizeof(bufs) / sizeof(*bufs); i++)
+        fwrite(bufs[i]->data, 1, bufs[i]->len, stdout);
+    fflush(stdout);
+}
+
+// Restores the state saved by write_pch(). Macros defined by the
+// image replace existing ones except those given on the command
+// line, and its tokens are prepended to the output of the next
+// preprocess() call.
+void read_pch(char *path) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1)
+        error("%s: %s", path, strerror(errno));
+
+    char *image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED)
+        error("%s: %s", path, strerror(errno));
+
+    PchHeader *hdr = (PchHeader *)image;
+    if (st.st_size < sizeof(PchHeader) || memcmp(hdr->magic, PCH_MAGIC, 8))
+        error("%s: not a precompiled header", path);
+
+    PchDep *deps = (PchDep *)(hdr + 1);
+    PchFile *files = (PchFile *)(deps + hdr->ndeps);
+    PchToken *ptoks = (PchToken *)(files + hdr->nfiles);
+    PchLiteral *plits = (PchLiteral *)(ptoks + hdr->ntokens);
+    PchMacro *pmacros = (PchMacro *)(plits + hdr->nliterals);
+    int *params = (int *)(pmacros + hdr->nmacros);
+    PchGuard *guards = (PchGuard *)(params + hdr->nparams);
+    int *once = (int *)(guards + hdr->nguards);
+    char *blob = (char *)(once + hdr->nonce);
+    if (blob + hdr->blob_size != image + st.st_size)
+        error("%s: corrupted precompiled header", path);
+
+    if (strcmp(blob + hdr->options, pch_options()))
+        error("%s: precompiled header was built with different -D, -U or -I options", path);
+
+    for (int i = 0; i < hdr->ndeps; i++) {
+        char *name = blob + deps[i].path;
+        struct stat st;
+        if (stat(name, &st) != 0 || st.st_size != deps[i].size ||
+            mtime_ns(&st) != deps[i].mtime)
+            error("%s: precompiled header is out of date: %s has changed", path, name);
+    }
+
+    // Each file gets a new file number in this compilation.
+    SourceFile **sfs = calloc(hdr->nfiles, sizeof(SourceFile *));
+    for (int i = 0; i < hdr->nfiles; i++)
+        sfs[i] = new_input_file(blob + files[i].name, blob);
+
+    Token *toks = arena_alloc(&token_arena, sizeof(Token) * hdr->ntokens);
+    for (int i = 0; i < hdr->ntokens; i++) {
+        PchToken *pt = &ptoks[i];
+        Token *tok = &toks[i];
+        mem_count(MEM_TOKEN, sizeof(Token));
+        tok->kind = pt->kind;
+        tok->loc = blob + pt->loc;
+        tok->len = pt->len;
+        tok->line_no = pt->line_no;
+        tok->file = sfs[pt->file]->index;
+        tok->at_bol = pt->at_bol;
+        tok->has_space = pt->has_space;
+        if (tok->kind != TK_EOF && i + 1 < hdr->ntokens)
+            tok->next = &toks[i + 1];
+
+        if (tok->kind == TK_IDENT || tok->kind == TK_RESERVED)
+            intern_token(tok);
+
+        if (pt->lit != -1) {
+            PchLiteral *pl = &plits[pt->lit];
+            tok->lit = arena_alloc(&token_arena, sizeof(Literal));
+            tok->lit->val = pl->val;
+            if (tok->kind == TK_STR) {
+                tok->lit->contents = blob + pl->contents;
+                tok->lit->cont_len = pl->cont_len;
+            } else {
+                tok->lit->ty = ty_int;
+            }
+        }
+    }
+
+    for (int i = 0; i < hdr->nmacros; i++) {
+        PchMacro *pm = &pmacros[i];
+        Macro *old = hashmap_get(&macros, blob + pm->name);
+        if (old && old->from_cmdline)
+            continue;
+
+        Macro *m = add_macro(blob + pm->name, pm->is_objlike,
+                             pm->body == -1 ? NULL : &toks[pm->body]);
+        m->is_variadic = pm->is_variadic;
+        m->deleted = pm->deleted;
+
+        MacroParam head = {};
+        MacroParam *cur = &head;
+        for (int j = 0; j < pm->nparams; j++) {
+            cur = cur->next = calloc(1, sizeof(MacroParam));
+            cur->name = intern(blob + params[pm->params + j],
+                               strlen(blob + params[pm->params + j]));
+        }
+        m->params = head.next;
+    }
+
+    for (int i = 0; i < hdr->nguards; i++)
+        hashmap_put(&include_guards, blob + guards[i].path, &toks[guards[i].tok]);
+
+    for (int i = 0; i < hdr->nonce; i++)
+        hashmap_put(&pragma_once, blob + once[i], blob + once[i]);
+
+    if (hdr->ntokens > 0 && toks[0].kind != TK_EOF)
+        pch_tokens = toks;
+}
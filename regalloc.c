@@ -0,0 +1,169 @@
+// This file chooses local variables to keep in registers.
+//
+// Variables normally live in the stack frame, so every use of one is
+// a memory access. This pass counts the uses of each local variable,
+// weighting a use inside a loop eight times as much as one outside,
+// and keeps the most used variables in registers for the whole
+// function. Integers and pointers go to the callee-saved registers
+// rbx and r12-r15, and floating-point values to XMM registers. The
+// register names are in codegen.c.
+//
+// Only scalar variables that are not volatile and whose address is
+// never taken are eligible. Functions that call setjmp() are left
+// alone, because longjmp() would restore stale register values.
+// A variable gets its register for the entire function rather than
+// for its live range, which is enough for the loop counters,
+// accumulators and pointers that dominate hot loops.
+//
+// This is a first step. Expression temporaries still live on the
+// register stack in codegen.c. The goal is a linear-scan allocator
+// over virtual registers that covers both temporaries and variables,
+// assigns registers per live range and can use all allocatable GPRs
+// and XMM registers.
+
+#include "zcc.h"
+
+bool opt_regalloc = true;
+
+// Uses in loops nested deeper than this are not weighted further.
+#define MAX_WEIGHT (1L << 40)
+
+static void mark_in_memory(Node *node) {
+    if (node->kind == ND_VAR)
+        node->var->in_memory = true;
+    else if (node->kind == ND_MEMBER)
+        mark_in_memory(node->lhs);
+    else if (node->kind == ND_COMMA)
+        mark_in_memory(node->rhs);
+}
+
+// True if the function being allocated calls setjmp().
+static bool calls_setjmp;
+
+static bool is_setjmp(Node *fn) {
+    if (fn->kind != ND_VAR)
+        return false;
+    char *name = fn->var->name;
+    return !strcmp(name, "setjmp") || !strcmp(name, "_setjmp") ||
+           !strcmp(name, "sigsetjmp") || !strcmp(name, "__sigsetjmp");
+}
+
+static void count_uses(Node *node, long weight);
+
+static void count_uses_list(Node *node, long weight) {
+    for (; node; node = node->next)
+        count_uses(node, weight);
+}
+
+static void count_uses(Node *node, long weight) {
+    if (!node)
+        return;
+
+    long inner = weight < MAX_WEIGHT ? weight * 8 : weight;
+
+    switch (node->kind) {
+    case ND_VAR:
+        if (node->var->is_local)
+            node->var->uses += weight;
+        return;
+    case ND_ADDR:
+        mark_in_memory(node->lhs);
+        break;
+    case ND_FUNCALL:
+        // Arguments are loaded from the stack frame.
+        for (int i = 0; i < node->nargs; i++)
+            node->args[i]->in_memory = true;
+        if (is_setjmp(node->lhs))
+            calls_setjmp = true;
+        break;
+    case ND_FOR:
+        count_uses(node->init, weight);
+        count_uses(node->cond, inner);
+        count_uses(node->then, inner);
+        count_uses(node->inc, inner);
+        return;
+    case ND_DO:
+        count_uses(node->then, inner);
+        count_uses(node->cond, inner);
+        return;
+    }
+
+    count_uses(node->lhs, weight);
+    count_uses(node->rhs, weight);
+    count_uses(node->cond, weight);
+    count_uses(node->then, weight);
+    count_uses(node->els, weight);
+    count_uses(node->init, weight);
+    count_uses(node->inc, weight);
+    count_uses_list(node->body, weight);
+}
+
+static bool is_eligible(Var *var) {
+    Type *ty = var->ty;
+    if (var->in_memory || var->uses == 0 || ty->is_volatile)
+        return false;
+    return is_integer(ty) || ty->kind == TY_PTR || is_flonum(ty);
+}
+
+static int compare_uses(const void *x, const void *y) {
+    Var *a = *(Var **)x;
+    Var *b = *(Var **)y;
+    if (a->uses != b->uses)
+        return a->uses < b->uses ? 1 : -1;
+    return 0;
+}
+
+// Sorts variables by the number of uses. Insertion sort keeps
+// variables with equal counts in declaration order, so the output
+// does not depend on the qsort() implementation.
+static void sort_by_uses(Var **vars, int len) {
+    for (int i = 1; i < len; i++) {
+        Var *var = vars[i];
+        int j = i - 1;
+        for (; j >= 0 && compare_uses(&vars[j], &var) > 0; j--)
+            vars[j + 1] = vars[j];
+        vars[j + 1] = var;
+    }
+}
+
+void alloc_regs(Function *fn) {
+    if (!opt_regalloc)
+        return;
+
+    calls_setjmp = false;
+    count_uses_list(fn->node, 1);
+    if (calls_setjmp)
+        return;
+
+    // Collect the most used variables of each kind. Only the top
+    // entries are kept, so that this stays linear in the number of
+    // variables.
+    Var *gp[NUM_GP_VAR_REGS + 1];
+    Var *fp[NUM_FP_VAR_REGS + 1];
+    int ngp = 0;
+    int nfp = 0;
+
+    for (Var *var = fn->locals; var; var = var->next) {
+        if (!is_eligible(var))
+            continue;
+
+        if (is_flonum(var->ty)) {
+            fp[nfp++] = var;
+            sort_by_uses(fp, nfp);
+            if (nfp > NUM_FP_VAR_REGS)
+                nfp--;
+        } else {
+            gp[ngp++] = var;
+            sort_by_uses(gp, ngp);
+            if (ngp > NUM_GP_VAR_REGS)
+                ngp--;
+        }
+    }
+
+    for (int i = 0; i < ngp; i++)
+        gp[i]->reg = i + 1;
+    for (int i = 0; i < nfp; i++)
+        fp[i]->reg = i + 1;
+    fn->gp_regs = ngp;
+    fn->fp_regs = nfp;
+}
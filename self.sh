@@ -11,8 +11,7 @@ mkdir -p $TMP
 zcc() {
     $CC -Iinclude -I/usr/local/include -I/usr/include \
         -I/usr/include/linux -I/usr/include/x86_64-linux-gnu \
-        -o $TMP/${1%.c}.s $1
-    gcc -c -o $TMP/${1%.c}.o $TMP/${1%.c}.s
+        -c -o $TMP/${1%.c}.o $1
 }
 
 cc() {
@@ -25,5 +24,11 @@ zcc parse.c
 zcc codegen.c
 zcc tokenize.c
 zcc preprocess.c
+zcc hashmap.c
+zcc arena.c
+zcc cache.c
+zcc asm.c
+zcc timing.c
+zcc regalloc.c
 
 (cd $TMP; gcc -o ../$OUTPUT *.o)
@@ -34,6 +34,19 @@ int add_all3(int x, int y, int z, ...) {
     }
 }
 
+// Passes some of the variadic arguments on the stack.
+int sum_ints(int n, ...);
+int call_sum_ints8() {
+    return sum_ints(8, 1, 2, 3, 4, 5, 6, 7, 8);
+}
+
+// Passes doubles and ints beyond the argument registers.
+double sum_mixed(int n, ...);
+double call_sum_mixed10() {
+    return sum_mixed(10, 1.0, 2, 3.0, 4, 5.0, 6, 7.0, 8, 9.0, 10,
+                     11.0, 12, 13.0, 14, 15.0, 16, 17.0, 18, 19.0, 20);
+}
+
 float add_float(float x, float y) {
     return x + y;
 }
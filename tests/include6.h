@@ -0,0 +1,4 @@
+#ifndef INCLUDE6_H
+#define INCLUDE6_H
+include6++;
+#endif
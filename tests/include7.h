@@ -0,0 +1,4 @@
+#ifndef INCLUDE7_H
+#define INCLUDE7_H
+#endif
+include7++;
@@ -162,12 +162,7 @@ int counter() {
 _Bool true_fn();
 _Bool false_fn();
 
-typedef struct {
-  int gp_offset;
-  int fp_offset;
-  void *overflow_arg_area;
-  void *reg_save_area;
-} va_list[1];
+#include "../include/stdarg.h"
 
 
 int add_all1(int x, ...);
@@ -182,10 +177,41 @@ char *fmt(char *buf, char *fmt, ...) {
   vsprintf(buf, fmt, ap);
 }
 
+int sum_ints(int n, ...) {
+  va_list ap;
+  va_start(ap, n);
+  int sum = 0;
+  for (int i = 0; i < n; i++)
+    sum += va_arg(ap, int);
+  va_end(ap);
+  return sum;
+}
+
+int call_sum_ints8();
+
+double sum_mixed(int n, ...) {
+  va_list ap;
+  va_start(ap, n);
+  double sum = 0;
+  for (int i = 0; i < n; i++) {
+    double d = va_arg(ap, double);
+    int x = va_arg(ap, int);
+    sum += (i + 1) * (d + x * 100);
+  }
+  va_end(ap);
+  return sum;
+}
+
+double call_sum_mixed10();
+
 int (*fnptr(void))(int) {
     return ret3;
 }
 
+long mix_args(double a, int b, float c, long d) {
+  return a * 1000 + b * 100 + c * 10 + d;
+}
+
 double add_double3(double x, double y, double z) {
   return x + y + z;
 }
@@ -196,6 +222,34 @@ float add_float3(float x, float y, float z) {
 
 int M9(int x) { return x*x; }
 
+long jmpbuf[32];
+int setjmp(long *buf);
+void longjmp(long *buf, int val);
+
+int volatile_longjmp(void) {
+  // Called through a pointer so that only `volatile` keeps v in memory.
+  int (*sj)(long *) = setjmp;
+  volatile int v = 0;
+  for (int k = 0; k < 3; k++)
+    v = v + 1;
+  if (!sj(jmpbuf)) {
+    v = 42;
+    longjmp(jmpbuf, 1);
+  }
+  return v;
+}
+
+int setjmp_longjmp(void) {
+  int v = 0;
+  for (int k = 0; k < 3; k++)
+    v = v + 1;
+  if (!setjmp(jmpbuf)) {
+    v = 42;
+    longjmp(jmpbuf, 1);
+  }
+  return v;
+}
+
 char *func_fn(void) {
   return __func__;
 }
@@ -543,6 +597,12 @@ int main() {
   assert(97, 'a', "'a'");
   assert(10, '\n', "'\\n'");
   assert(4, sizeof('a'), "sizeof('a')");
+  assert(97, L'a', "L'a'");
+  assert(4, sizeof(L'a'), "sizeof(L'a')");
+  assert(255, L'\xff', "L'\\xff'");
+  assert(-1, '\xff', "'\\xff'");
+  assert(233, L'é', "L'é'");
+  assert(128512, L'😀', "L'😀'");
 
   assert(0, ({ enum { zero, one, two }; zero; }), "({ enum { zero, one, two }; zero; })");
   assert(1, ({ enum { zero, one, two }; one; }), "({ enum { zero, one, two }; one; })");
@@ -914,7 +974,15 @@ int main() {
   assert(6, add_all3(1,2,3,0), "add_all3(1,2,3,0)");
   assert(5, add_all3(1,2,3,-1,0), "add_all3(1,2,3,-1,0)");
 
+  assert(10, sum_ints(4,1,2,3,4), "sum_ints(4,1,2,3,4)");
+  assert(36, call_sum_ints8(), "call_sum_ints8()");
+  assert(1007, sum_mixed(2, 1.0, 2, 3.0, 4), "sum_mixed(2, 1.0, 2, 3.0, 4)");
+  assert(0, ({ char buf[100]; fmt(buf, "%.1f %.1f %d", 1.5, 2.5, 3); strcmp(buf, "1.5 2.5 3"); }), "({ char buf[100]; fmt(buf, \"%.1f %.1f %d\", 1.5, 2.5, 3); strcmp(buf, \"1.5 2.5 3\"); })");
+  assert(77715, call_sum_mixed10(), "call_sum_mixed10()");
+
   assert(0, ({ char buf[100]; sprintf(buf, "%d %d %s", 1, 2, "foo"); strcmp("1 2 foo", buf); }), "({ char buf[100]; sprintf(buf, \"%d %d %s\", 1, 2, \"foo\"); strcmp(\"1 2 foo\", buf); })");
+  assert(0, ({ char buf[100]; sprintf(buf, "%.1f %d", 1.5, 2); strcmp("1.5 2", buf); }), "({ char buf[100]; sprintf(buf, \"%.1f %d\", 1.5, 2); strcmp(\"1.5 2\", buf); })");
+  assert(1234, mix_args(1.0, 2, 3.0, 4), "mix_args(1.0, 2, 3.0, 4)");
 
   assert(0, ({ char buf[100]; fmt(buf, "%d %d %s", 1, 2, "foo"); strcmp("1 2 foo", buf); }), "({ char buf[100]; fmt(buf, \"%d %d %s\", 1, 2, \"foo\"); strcmp(\"1 2 foo\", buf); })");
 
@@ -1080,6 +1148,8 @@ int main() {
   { volatile int x; }
   { volatile int volatile volatile x; }
   { int volatile * volatile volatile x; }
+  { int *restrict x; }
+  { int * const restrict x = 0; }
 
 
   assert(5, (add2)(2,3), "(add2)(2,3)");
@@ -1500,6 +1570,25 @@ of(char), \
 
 #undef foo
 
+  int include5 = 0;
+#include "include5.h"
+#include "include5.h"
+#include "./include5.h"
+  assert(1, include5, "include5");
+
+  int include6 = 0;
+#include "include6.h"
+#include "include6.h"
+  assert(1, include6, "include6");
+#undef INCLUDE6_H
+#include "include6.h"
+  assert(2, include6, "include6");
+
+  int include7 = 0;
+#include "include7.h"
+#include "include7.h"
+  assert(2, include7, "include7");
+
   assert(1, __STDC__, "__STDC__");
 
   assert(0, strcmp(main_filename, "tests.c"), "strcmp(main_filename, \"tests.c\")");
@@ -1575,6 +1664,28 @@ of(char), \
   assert(8, sizeof(struct {int a:3; int:0; int c:5;}), "sizeof(struct {int a:3; int:0; int c:5;})");
   assert(4, sizeof(struct {int a:3; int:0;}), "sizeof(struct {int a:3; int:0;})");
 
+  assert(16, sizeof(struct { int a; union { int b; long c; }; }), "sizeof(struct { int a; union { int b; long c; }; })");
+  assert(3, ({ struct { int a; union { int b; long c; }; } x; x.a=1; x.c=3; x.b; }), "({ struct { int a; union { int b; long c; }; } x; x.a=1; x.c=3; x.b; })");
+  assert(5, ({ struct { struct { int a; struct { int b; }; }; } x; x.a=2; x.b=5; x.b; }), "({ struct { struct { int a; struct { int b; }; }; } x; x.a=2; x.b=5; x.b; })");
+
+  assert(-128, ({ char x=127; x++; x; }), "({ char x=127; x++; x; })");
+  assert(127, ({ char x=127; x++; }), "({ char x=127; x++; })");
+  assert(-128, ({ char x=-128; x--; }), "({ char x=-128; x--; })");
+  assert(255, ({ unsigned char x=255; x++; }), "({ unsigned char x=255; x++; })");
+  assert(127, ({ char x[1]={127}; x[0]++; }), "({ char x[1]={127}; x[0]++; })");
+  assert(1, ({ _Bool b=1; b++; }), "({ _Bool b=1; b++; })");
+  assert(1, ({ _Bool b=1; b++; b; }), "({ _Bool b=1; b++; b; })");
+  assert(0, ({ _Bool b=0; b--; }), "({ _Bool b=0; b--; })");
+  assert(1, ({ _Bool b=0; b--; b; }), "({ _Bool b=0; b--; b; })");
+  assert(1, ({ _Bool b[1]={1}; b[0]++; }), "({ _Bool b[1]={1}; b[0]++; })");
+  assert(1, ({ float f=16777216; f++ == 16777216; }), "({ float f=16777216; f++ == 16777216; })");
+  assert(1, ({ unsigned char x=255; x+=2; x; }), "({ unsigned char x=255; x+=2; x; })");
+  assert(-32768, ({ short x=32767; x+=1; x; }), "({ short x=32767; x+=1; x; })");
+  assert(5, ({ double d=0; for (int i=0; i<10; i++) d+=0.5; (int)d; }), "({ double d=0; for (int i=0; i<10; i++) d+=0.5; (int)d; })");
+  assert(42, volatile_longjmp(), "volatile_longjmp()");
+  assert(42, setjmp_longjmp(), "setjmp_longjmp()");
+  assert(6, ({ double d=2.5; float f=0.5; int n=strcmp("a", "a"); (int)(d*2+f*2+n); }), "({ double d=2.5; float f=0.5; int n=strcmp(\"a\", \"a\"); (int)(d*2+f*2+n); })");
+
   assert(18, Σ, "Σ");
   assert(3, ({ int β=3; β; }), "({ int β=3; β; })");
   assert(3, ({ int あ=3; あ; }), "({ int あ=3; あ; })");
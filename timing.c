@@ -0,0 +1,230 @@
+// This file implements -ftime-report and -ftime-trace.
+//
+// Each phase of the compiler, each #include and each function is
+// bracketed by timer_start() and timer_stop(), which record a nested
+// event with a start time and a duration. -ftime-report prints the
+// total time per phase, the time of events nested in the phases and
+// the most expensive headers and functions to stderr. -ftime-trace
+// writes all events in the Chrome trace event format, which can be
+// opened in chrome://tracing or Perfetto.
+//
+// Timers are no-ops unless one of the options is given, so they can
+// stay in the compiler permanently.
+
+#include "zcc.h"
+#include <time.h>
+
+bool opt_time_report;
+char *opt_time_trace;
+
+long stat_macro_expansions;
+
+typedef struct {
+    char *name;
+    char *detail;
+    long start; // in nanoseconds
+    long dur;
+    int depth;  // 0 for a top-level event
+    int parent; // Index of the enclosing event or -1
+} TimerEvent;
+
+static TimerEvent *events;
+static int nevents;
+
+// Indices of events that have been started but not stopped
+#define MAX_DEPTH 64
+static int stack[MAX_DEPTH];
+static int depth;
+
+static long now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static bool timer_enabled(void) {
+    return opt_time_report || opt_time_trace;
+}
+
+// Starts a new event. `detail` is a file or function name, or NULL.
+void timer_start(char *name, char *detail) {
+    if (!timer_enabled())
+        return;
+    if (depth == MAX_DEPTH)
+        error("internal error: timers nested too deeply");
+
+    if ((nevents & (nevents - 1)) == 0)
+        events = realloc(events, sizeof(TimerEvent) * (nevents ? nevents * 2 : 1));
+
+    TimerEvent *ev = &events[nevents];
+    ev->name = name;
+    ev->detail = detail;
+    ev->start = now();
+    ev->dur = 0;
+    ev->depth = depth;
+    ev->parent = depth ? stack[depth - 1] : -1;
+    stack[depth++] = nevents++;
+}
+
+// Stops the innermost running event.
+void timer_stop(void) {
+    if (!timer_enabled())
+        return;
+    assert(depth > 0);
+    TimerEvent *ev = &events[stack[--depth]];
+    ev->dur = now() - ev->start;
+}
+
+//
+// -ftime-report
+//
+
+typedef struct {
+    char *key;
+    long total;
+    int count;
+} TimerSum;
+
+static int compare_sums(const void *x, const void *y) {
+    const TimerSum *a = x;
+    const TimerSum *b = y;
+    if (a->total != b->total)
+        return a->total < b->total ? 1 : -1;
+    return 0;
+}
+
+// Returns true if an event is enclosed by another one of the same
+// name, e.g. a header included by another header. Its time is
+// already part of the outer event's.
+static bool is_recursive(TimerEvent *ev) {
+    for (int i = ev->parent; i != -1; i = events[i].parent)
+        if (!strcmp(events[i].name, ev->name))
+            return true;
+    return false;
+}
+
+// Sums up events between the given nesting depths by name, or by
+// detail if `name` is given, and returns them sorted by total time.
+static TimerSum *sum_events(char *name, int min_depth, int max_depth, int *len) {
+    TimerSum *sums = calloc(nevents + 1, sizeof(TimerSum));
+    HashMap map = {};
+    int n = 0;
+
+    for (int i = 0; i < nevents; i++) {
+        TimerEvent *ev = &events[i];
+        if (ev->depth < min_depth || max_depth < ev->depth)
+            continue;
+        if (name ? strcmp(ev->name, name) : is_recursive(ev))
+            continue;
+
+        char *key = name ? ev->detail : ev->name;
+        TimerSum *sum = hashmap_get(&map, key);
+        if (!sum) {
+            sum = &sums[n++];
+            sum->key = key;
+            hashmap_put(&map, key, sum);
+        }
+        sum->total += ev->dur;
+        sum->count++;
+    }
+
+    free(map.buckets);
+    qsort(sums, n, sizeof(TimerSum), compare_sums);
+    *len = n;
+    return sums;
+}
+
+static void print_sums(char *title, TimerSum *sums, int len, int max) {
+    fprintf(stderr, "%-40s %12s %8s\n", title, "time (ms)", "count");
+    for (int i = 0; i < len && i < max; i++)
+        fprintf(stderr, "  %-38s %12.3f %8d\n",
+                sums[i].key, sums[i].total / 1e6, sums[i].count);
+}
+
+void print_time_report(void) {
+    // Phases are the top-level events and the ones directly inside
+    // them, e.g. "total" and "parse". They don't overlap, so their
+    // times add up. Everything nested deeper, such as tokenizing a
+    // header during "preprocess", is reported separately.
+    int len;
+    TimerSum *sums = sum_events(NULL, 0, 1, &len);
+    print_sums("phase", sums, len, len);
+    free(sums);
+
+    sums = sum_events(NULL, 2, MAX_DEPTH, &len);
+    if (len > 0) {
+        fprintf(stderr, "\n");
+        print_sums("within phases", sums, len, len);
+    }
+    free(sums);
+
+    // Headers and functions that took longest
+    char *names[] = {"include", "parse function", "codegen function"};
+    for (int i = 0; i < sizeof(names) / sizeof(*names); i++) {
+        sums = sum_events(names[i], 0, MAX_DEPTH, &len);
+        if (len > 0) {
+            fprintf(stderr, "\n");
+            print_sums(names[i], sums, len, 10);
+        }
+        free(sums);
+    }
+
+    fprintf(stderr, "\n%-40s %12ld\n", "tokens", mem_objects(MEM_TOKEN));
+    fprintf(stderr, "%-40s %12ld\n", "macro expansions", stat_macro_expansions);
+    fprintf(stderr, "%-40s %12ld\n", "nodes", mem_objects(MEM_NODE));
+    fprintf(stderr, "%-40s %12ld\n", "types", mem_objects(MEM_TYPE));
+}
+
+//
+// -ftime-trace
+//
+
+static void print_json_string(FILE *fp, char *s) {
+    fputc('"', fp);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fprintf(fp, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(fp, "\\u%04x", *s);
+        else
+            fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
+
+void write_time_trace(char *path) {
+    FILE *fp = fopen(path, "w");
+    if (!fp)
+        error("cannot open %s: %s", path, strerror(errno));
+
+    long base = nevents ? events[0].start : 0;
+    long end = base;
+    int pid = getpid();
+
+    fprintf(fp, "{\"traceEvents\":[\n");
+    for (int i = 0; i < nevents; i++) {
+        TimerEvent *ev = &events[i];
+        fprintf(fp, "{\"name\":");
+        print_json_string(fp, ev->name);
+        fprintf(fp, ",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                pid, pid, (ev->start - base) / 1e3, ev->dur / 1e3);
+        if (ev->detail) {
+            fprintf(fp, ",\"args\":{\"detail\":");
+            print_json_string(fp, ev->detail);
+            fprintf(fp, "}");
+        }
+        fprintf(fp, "},\n");
+
+        if (end < ev->start + ev->dur)
+            end = ev->start + ev->dur;
+    }
+
+    fprintf(fp, "{\"name\":\"counters\",\"ph\":\"C\",\"pid\":%d,\"ts\":%.3f,",
+            pid, (end - base) / 1e3);
+    fprintf(fp, "\"args\":{\"tokens\":%ld,\"macro expansions\":%ld,"
+                "\"nodes\":%ld,\"types\":%ld}}\n",
+            mem_objects(MEM_TOKEN), stat_macro_expansions,
+            mem_objects(MEM_NODE), mem_objects(MEM_TYPE));
+    fprintf(fp, "],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(fp);
+}
@@ -1,10 +1,23 @@
 #include "zcc.h"
 
-// Input filename
-static char *current_filename;
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
-// Input string
-static char *current_input;
+// All input buffers, indexed by Token::file
+static SourceFile **source_files;
+static int nsource_files;
+static int source_files_cap;
+
+// Input file
+static SourceFile *current_file;
+
+// Position info for the next token
+static int current_line;
+static bool at_bol;
+static bool has_space;
 
 // Reports an error and exit.
 void error(char *fmt, ...) {
@@ -45,31 +58,93 @@ static void verror_at(char *filename, char *input, int line_no,
 
 static void error_at(char *loc, char *fmt, ...) {
     int line_no = 1;
-    for (char *p = current_input; p < loc; p++)
+    for (char *p = current_file->contents; p < loc; p++)
         if (*p == '\n')
             line_no++;
     
     va_list ap;
     va_start(ap, fmt);
-    verror_at(current_filename, current_input, line_no, loc, fmt, ap);
+    verror_at(current_file->name, current_file->contents, line_no, loc, fmt, ap);
     exit(1);
 }
 
 void error_tok(Token *tok, char *fmt, ...) {
+    SourceFile *file = get_source_file(tok);
     va_list ap;
     va_start(ap, fmt);
-    verror_at(tok->filename, tok->input, tok->line_no, tok->loc, fmt, ap);
+    verror_at(file->name, file->contents, tok->line_no, tok->loc, fmt, ap);
     exit(1);
 }
 
+// Number of warnings reported so far
+int warning_count;
+
 void warn_tok(Token *tok, char *fmt, ...) {
+    warning_count++;
+    SourceFile *file = get_source_file(tok);
     va_list ap;
     va_start(ap, fmt);
-    verror_at(tok->filename, tok->input, tok->line_no, tok->loc, fmt, ap);
+    verror_at(file->name, file->contents, tok->line_no, tok->loc, fmt, ap);
+}
+
+// An interned name and the keyword or punctuator id it stands for.
+typedef struct {
+    char *name;
+    TokenId id;
+} Symbol;
+
+// The text of each TokenId, in the same order as the enum.
+static char *reserved_names[] = {
+    "",
+    "return", "if", "else", "for", "while", "int", "sizeof", "char",
+    "struct", "union", "short", "long", "void", "typedef", "_Bool",
+    "enum", "static", "break", "continue", "goto", "switch", "case",
+    "default", "extern", "alignof", "_Alignas", "do", "signed",
+    "unsigned", "const", "volatile", "restrict", "float", "double",
+    "(", ")", "{", "}", "[", "]", ";", ",", ".", "...", "->",
+    "+", "-", "*", "/", "%", "&", "|", "^", "~", "!", "?", ":",
+    "<", ">", "=", "#", "##", "==", "!=", "<=", ">=",
+    "+=", "-=", "*=", "/=", "%=", "&=", "|=", "^=", "<<=", ">>=",
+    "++", "--", "&&", "||", "<<", ">>",
+    "include", "define", "undef", "ifdef", "ifndef", "elif", "endif",
+    "error", "defined", "pragma", "once",
+};
+
+// All identifier and punctuator names, keyed by their contents.
+// Each name is stored only once, so two names can be compared by
+// their pointers once they are interned.
+static HashMap symbols;
+
+static Symbol *intern2(char *s, int len, unsigned int hash) {
+    static bool initialized;
+    if (!initialized) {
+        initialized = true;
+        assert(sizeof(reserved_names) / sizeof(*reserved_names) == NUM_TOKEN_IDS);
+        for (int i = 1; i < NUM_TOKEN_IDS; i++) {
+            char *name = reserved_names[i];
+            intern2(name, strlen(name), fnv_hash(name, strlen(name)))->id = i;
+        }
+    }
+
+    Symbol *sym = hashmap_get3(&symbols, s, len, hash);
+    if (sym)
+        return sym;
+
+    sym = calloc(1, sizeof(Symbol));
+    sym->name = strndup(s, len);
+    hashmap_put3(&symbols, sym->name, len, hash, sym);
+    return sym;
+}
+
+// Returns the canonical copy of a given name.
+char *intern(char *s, int len) {
+    return intern2(s, len, fnv_hash(s, len))->name;
 }
 
 // Consumes the current token if it matches `op`.
 bool equal(Token *tok, char *op) {
+    if (tok->sym)
+        return tok->sym[0] == op[0] && !strcmp(tok->sym, op);
     return strlen(op) == tok->len &&
             !strncmp(tok->loc, op, tok->len);
 }
@@ -91,17 +166,37 @@ bool consume(Token **rest, Token *tok, char *str) {
 }
 
 // Create a new token and add it as the next token of `cur`.
+// Sets `hash`, `sym` and `id` of an identifier or punctuator token.
+void intern_token(Token *tok) {
+    tok->hash = fnv_hash(tok->loc, tok->len);
+    Symbol *sym = intern2(tok->loc, tok->len, tok->hash);
+    tok->sym = sym->name;
+    tok->id = sym->id;
+}
+
 static Token *new_token(TokenKind kind, Token *cur, char *str, int len) {
-    Token *tok = calloc(1, sizeof(Token));
+    Token *tok = arena_alloc(&token_arena, sizeof(Token));
+    mem_count(MEM_TOKEN, sizeof(Token));
     tok->kind = kind;
     tok->loc = str;
     tok->len = len;
-    tok->filename = current_filename;
-    tok->input = current_input;
+    tok->file = current_file->index;
+    tok->line_no = current_line;
+    tok->at_bol = at_bol;
+    tok->has_space = has_space;
+    at_bol = has_space = false;
+
+    if (kind == TK_IDENT || kind == TK_RESERVED)
+        intern_token(tok);
+
     cur->next = tok;
     return tok;
 }
 
+static Literal *new_literal(void) {
+    return arena_alloc(&token_arena, sizeof(Literal));
+}
+
 static bool startswith(char *p, char *q) {
     return strncmp(p, q, strlen(q)) == 0;
 }
@@ -114,6 +209,106 @@ static bool is_alnum(char c) {
     return is_alpha(c) || ('0' <= c && c <= '9');
 }
 
+// Scanners for the hot loops of the tokenizer.
+//
+// When the host compiler supports SSE2 or AVX2, they look at 16 or 32
+// bytes at a time. Every input buffer is NUL-terminated and every
+// scanner stops at '\0', so reading past the terminator is harmless
+// as long as the load doesn't cross a page boundary. Near the end of
+// a page we fall back to the scalar loop for one character.
+#if defined(__AVX2__)
+#define VEC_SIZE 32
+#define VEC_ALL_ONES 0xffffffffu
+typedef __m256i Vec;
+#define vec_load(p) _mm256_loadu_si256((Vec *)(p))
+#define vec_set1(c) _mm256_set1_epi8(c)
+#define vec_eq(x, y) _mm256_cmpeq_epi8(x, y)
+#define vec_or(x, y) _mm256_or_si256(x, y)
+#define vec_sub(x, y) _mm256_sub_epi8(x, y)
+#define vec_min(x, y) _mm256_min_epu8(x, y)
+#define vec_mask(x) (unsigned)_mm256_movemask_epi8(x)
+#elif defined(__SSE2__)
+#define VEC_SIZE 16
+#define VEC_ALL_ONES 0xffffu
+typedef __m128i Vec;
+#define vec_load(p) _mm_loadu_si128((Vec *)(p))
+#define vec_set1(c) _mm_set1_epi8(c)
+#define vec_eq(x, y) _mm_cmpeq_epi8(x, y)
+#define vec_or(x, y) _mm_or_si128(x, y)
+#define vec_sub(x, y) _mm_sub_epi8(x, y)
+#define vec_min(x, y) _mm_min_epu8(x, y)
+#define vec_mask(x) (unsigned)_mm_movemask_epi8(x)
+#endif
+
+#ifdef VEC_SIZE
+#define PAGE_SIZE 4096
+
+static bool can_load(char *p) {
+    return ((unsigned long)p & (PAGE_SIZE - 1)) <= PAGE_SIZE - VEC_SIZE;
+}
+
+// Returns a mask of bytes in [lo, hi].
+static Vec vec_in_range(Vec x, char lo, char hi) {
+    Vec y = vec_sub(x, vec_set1(lo));
+    return vec_eq(vec_min(y, vec_set1(hi - lo)), y);
+}
+#endif
+
+// Skips spaces and tabs.
+static char *skip_blanks(char *p) {
+#ifdef VEC_SIZE
+    while (can_load(p)) {
+        Vec x = vec_load(p);
+        unsigned m = vec_mask(vec_or(vec_eq(x, vec_set1(' ')), vec_eq(x, vec_set1('\t'))));
+        if (m != VEC_ALL_ONES)
+            return p + __builtin_ctz(~m);
+        p += VEC_SIZE;
+    }
+#endif
+    while (*p == ' ' || *p == '\t')
+        p++;
+    return p;
+}
+
+// Skips characters that can be part of an identifier.
+static char *skip_ident(char *p) {
+#ifdef VEC_SIZE
+    while (can_load(p)) {
+        Vec x = vec_load(p);
+        Vec lower = vec_or(x, vec_set1(0x20));
+        unsigned m = vec_mask(vec_or(vec_or(vec_in_range(lower, 'a', 'z'),
+                                            vec_in_range(x, '0', '9')),
+                                     vec_eq(x, vec_set1('_'))));
+        m |= vec_mask(x); // non-ASCII bytes
+        if (m != VEC_ALL_ONES)
+            return p + __builtin_ctz(~m);
+        p += VEC_SIZE;
+    }
+#endif
+    while (is_alnum(*p) || (*p & 0x80))
+        p++;
+    return p;
+}
+
+// Returns the first occurrence of c1, c2, c3 or '\0'.
+static char *find_char3(char *p, char c1, char c2, char c3) {
+#ifdef VEC_SIZE
+    while (can_load(p)) {
+        Vec x = vec_load(p);
+        unsigned m = vec_mask(vec_or(vec_or(vec_eq(x, vec_set1(c1)),
+                                            vec_eq(x, vec_set1(c2))),
+                                     vec_or(vec_eq(x, vec_set1(c3)),
+                                            vec_eq(x, vec_set1('\0')))));
+        if (m)
+            return p + __builtin_ctz(m);
+        p += VEC_SIZE;
+    }
+#endif
+    while (*p != c1 && *p != c2 && *p != c3 && *p != '\0')
+        p++;
+    return p;
+}
+
 static bool is_hex(char c) {
     return ('0' <= c && c <= '9') ||
            ('a' <= c && c <= 'f') ||
@@ -129,21 +324,10 @@ static int from_hex(char c) {
 }
 
 static bool is_keyword(Token *tok) {
-    static char *kw[] = {
-        "return", "if", "else", "for", "while", "int", "sizeof", "char",
-        "struct", "union", "short", "long", "void", "typedef", "_Bool",
-        "enum", "static", "break", "continue", "goto", "switch", "case",
-        "default", "extern", "alignof", "_Alignas", "do", "signed",
-        "unsigned", "const", "volatile", "float", "double",
-    };
-
-    for (int i = 0; i < sizeof(kw) / sizeof(*kw); i++)
-        if (equal(tok, kw[i]))
-            return true;
-    return false;
+    return KW_RETURN <= tok->id && tok->id <= KW_DOUBLE;
 }
 
-static char read_escaped_char(char **new_pos, char *p) {
+static int read_escaped_char(char **new_pos, char *p) {
     if ('0' <= *p && *p <= '7') {
         // Read an octal number.
         int c = *p++ - '0';
@@ -192,11 +376,13 @@ static Token *read_string_literal(Token *cur, char *start) {
     char *end = p;
 
     // Find the closing double-quote.
-    for (; *end != '"'; end++) {
-        if (*end == '\0')
+    for (;;) {
+        end = find_char3(end, '"', '\\', '\\');
+        if (*end == '"')
+            break;
+        if (*end == '\0' || end[1] == '\0')
             error_at(start, "unclosed string literal");
-        if (*end == '\\')
-            end++;
+        end += 2;
     } // After the `for` statement, end = `"` 
 
     // Allocate a buffer that is large enough to hold the entire string.
@@ -213,29 +399,71 @@ static Token *read_string_literal(Token *cur, char *start) {
     buf[len++] = '\0'; // After the line, buf = 'f' 'o' 'o' '\0', len = 4
 
     Token *tok = new_token(TK_STR, cur, start, p - start + 1); // *start = `"`, *(p-start+1)=5
-    tok->contents = buf; // tok->contents = 'f' 'o' 'o' '\0'
-    tok->cont_len = len; // tok->cont_len = 4
+    tok->lit = new_literal();
+    tok->lit->contents = buf; // tok->lit->contents = 'f' 'o' 'o' '\0'
+    tok->lit->cont_len = len; // tok->lit->cont_len = 4
     return tok;
 }
 
-static Token *read_char_literal(Token *cur, char *start) {
-    char *p = start + 1;
+// Reads a UTF-8 encoded character and returns its code point.
+static int decode_utf8(char **new_pos, char *p) {
+    unsigned char *s = (unsigned char *)p;
+    if (*s < 0x80) {
+        *new_pos = p + 1;
+        return *s;
+    }
+
+    int len, c;
+    if (*s >= 0b11110000) {
+        len = 4;
+        c = *s & 0b111;
+    } else if (*s >= 0b11100000) {
+        len = 3;
+        c = *s & 0b1111;
+    } else if (*s >= 0b11000000) {
+        len = 2;
+        c = *s & 0b11111;
+    } else {
+        error_at(p, "invalid UTF-8 sequence");
+    }
+
+    for (int i = 1; i < len; i++) {
+        if ((s[i] >> 6) != 0b10)
+            error_at(p, "invalid UTF-8 sequence");
+        c = (c << 6) | (s[i] & 0b111111);
+    }
+    *new_pos = p + len;
+    return c;
+}
+
+// Reads a character literal. `quote` points to the opening quote,
+// which is preceded by `L` if it is a wide character literal.
+static Token *read_char_literal(Token *cur, char *start, char *quote) {
+    char *p = quote + 1;
     if (*p == '\0')
         error_at(start, "unclosed char literal");
 
-    char c;
+    // A plain character literal has the value of a char, so '\xff'
+    // is -1. A wide one has the value of a wchar_t, i.e. the code point.
+    bool wide = quote != start;
+    int c;
     if (*p == '\\')
         c = read_escaped_char(&p, p + 1);
+    else if (wide)
+        c = decode_utf8(&p, p);
     else
         c = *p++;
+    if (!wide)
+        c = (char)c;
 
     if (*p != '\'')
         error_at(p, "char literal too long");
     p++;
 
     Token *tok = new_token(TK_NUM, cur, start, p - start);
-    tok->val = c;
-    tok->ty = ty_int;
+    tok->lit = new_literal();
+    tok->lit->val = c;
+    tok->lit->ty = ty_int;
     return tok;
 }
 
@@ -312,8 +540,9 @@ static bool convert_pp_int(Token *tok) {
         return false;
 
     tok->kind = TK_NUM;
-    tok->val = val;
-    tok->ty = ty;
+    tok->lit = new_literal();
+    tok->lit->val = val;
+    tok->lit->ty = ty;
     return true;
 }
 
@@ -348,8 +577,9 @@ static void convert_pp_number(Token *tok) {
         error_tok(tok, "invalid numeric constant");
 
     tok->kind = TK_NUM;
-    tok->fval = val;
-    tok->ty = ty;
+    tok->lit = new_literal();
+    tok->lit->fval = val;
+    tok->lit->ty = ty;
 }
 
 void convert_pp_tokens(Token *tok) {
@@ -366,61 +596,89 @@ void convert_pp_tokens(Token *tok) {
     }
 }
 
-// Initialize token position info for all tokens.
-static void add_line_info(Token *tok) {
-    char *p = current_input;
-    int line_no = 1;
-    bool at_bol = true;
-    bool has_space = false;
-
-    do {
-        if (p == tok->loc) {
-            tok->line_no = line_no;
-            tok->at_bol = at_bol; 
-            tok->has_space = has_space;
-            tok = tok->next;
-        }
+// Registers an input buffer and returns its descriptor. Tokens
+// created from `contents` will refer to it.
+SourceFile *new_source_file(char *name, int file_no, char *contents) {
+    if (nsource_files == source_files_cap) {
+        source_files_cap = source_files_cap ? source_files_cap * 2 : 64;
+        source_files = realloc(source_files, sizeof(SourceFile *) * source_files_cap);
+    }
 
-        if (*p == '\n') {
-            line_no++;
-            at_bol = true; // Set at_bol of next token to true if *p is `\n`.
-        } else if (isspace(*p)) {
-            has_space = true; // Set has_space of next token to true if *p is space.
-        } else {
-            at_bol = false; // Set at_bol of next token to false if *p isn't space.
-            has_space = false; // Set has_space of next token to false if *p isn't space.
-        }
-    } while (*p++);
+    SourceFile *file = arena_alloc(&token_arena, sizeof(SourceFile));
+    file->name = name;
+    file->file_no = file_no;
+    file->index = nsource_files;
+    file->contents = contents;
+    source_files[nsource_files++] = file;
+    return file;
+}
+
+SourceFile *get_source_file(Token *tok) {
+    return source_files[tok->file];
+}
+
+// Returns all input buffers registered so far.
+SourceFile **get_source_files(int *len) {
+    *len = nsource_files;
+    return source_files;
 }
 
 // Tokenize a given string and returns new tokens.
-Token *tokenize(char *filename, int file_no, char *p) {
-    current_filename = filename;
-    current_input = p;
+Token *tokenize(SourceFile *file) {
+    current_file = file;
+
+    char *p = file->contents;
     Token head = {};
     Token *cur = &head;
 
+    // Line numbers and the at_bol/has_space flags are tracked as we
+    // go. A token is at the beginning of a line if only whitespace
+    // precedes it on the line, and it has a preceding space if the
+    // last non-newline character before it is a whitespace. Comment
+    // characters count as non-whitespace.
+    current_line = 1;
+    at_bol = true;
+    has_space = false;
+
     while (*p) {
         // Skip line comments.
         if (startswith(p, "//")) {
-            p += 2;
-            while (*p != '\n')
-                p++;
+            p = find_char3(p + 2, '\n', '\n', '\n');
+            at_bol = false;
+            has_space = isspace(p[-1]);
             continue;
         }
 
         // Skip block comments.
         if (startswith(p, "/*")) {
-            char *q = strstr(p + 2, "*/");
-            if (!q)
-                error_at(p, "unclosed block comment");
+            char *q = p + 2;
+            for (;;) {
+                q = find_char3(q, '*', '\n', '\n');
+                if (*q == '\0')
+                    error_at(p, "unclosed block comment");
+                if (*q == '\n')
+                    current_line++;
+                else if (q[1] == '/')
+                    break;
+                q++;
+            }
             p = q + 2;
+            at_bol = has_space = false;
+            continue;
+        }
+
+        // Skip newline.
+        if (*p == '\n') {
+            p++;
+            current_line++;
+            at_bol = true;
             continue;
         }
 
         // Skip whitespace characters.
         if (isspace(*p)) {
-            p++;
+            p = skip_blanks(p + 1);
+            has_space = true;
             continue;
         }
 
@@ -448,16 +706,22 @@ Token *tokenize(char *filename, int file_no, char *p) {
 
         // Character literal
         if (*p == '\'') {
-            cur = read_char_literal(cur, p);
+            cur = read_char_literal(cur, p, p);
+            p += cur->len;
+            continue;
+        }
+
+        // Wide character literal
+        if (p[0] == 'L' && p[1] == '\'') {
+            cur = read_char_literal(cur, p, p + 1);
             p += cur->len;
             continue;
         }
 
         // Identifier
         if (is_alpha(*p) || (*p & 0x80)) {
-            char *q = p++;
-            while (is_alnum(*p) || (*p & 0x80))
-                p++;
+            char *q = p;
+            p = skip_ident(p + 1);
             cur = new_token(TK_IDENT, cur, q, p - q);
             continue;
         }
@@ -496,13 +760,44 @@ Token *tokenize(char *filename, int file_no, char *p) {
     }
 
     new_token(TK_EOF, cur, p, 0);
-
-    for (Token *t = head.next; t; t = t->next)
-        t->file_no = file_no;
-    add_line_info(head.next);
     return head.next;
 }
 
+// Maps a given file into memory. The mapping is private, so the
+// pages are shared with the page cache until someone writes to them.
+// Returns NULL if the file isn't a regular file or if the last page
+// has no room for the trailing "\n\0", in which case the caller falls
+// back to reading the file.
+static char *map_file(char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return NULL;
+    }
+
+    // Bytes past the end of file up to the end of the last page
+    // read as zero, so the buffer is already NUL-terminated.
+    long size = st.st_size;
+    long rem = size % sysconf(_SC_PAGESIZE);
+    if (rem == 0 || rem > sysconf(_SC_PAGESIZE) - 2) {
+        close(fd);
+        return NULL;
+    }
+
+    char *buf = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (buf == MAP_FAILED)
+        return NULL;
+
+    if (buf[size - 1] != '\n')
+        buf[size] = '\n';
+    return buf;
+}
+
 // Returns the contents of a given file.
 static char *read_file(char *path) {
     FILE *fp;
@@ -511,6 +806,10 @@ static char *read_file(char *path) {
         // By convention, read from stdin if a given filename is "-".
         fp = stdin;
     } else {
+        char *buf = map_file(path);
+        if (buf)
+            return buf;
+
         fp = fopen(path, "r");
         if (!fp)
             return NULL;
@@ -544,7 +843,8 @@ static char *read_file(char *path) {
     return buf;
 }
 
-// Removes backslashes followed by a newline.
+// Removes backslashes followed by a newline. `p` points to the
+// first one; the text before it is left untouched.
 static void remove_backslash_newline(char *p) {
     char *q = p;
 
@@ -609,7 +909,22 @@ static int read_universal_char(char *p, int len) {
     return (c <= 0x10FFFF) ? c : 0;
 }
 
+// Returns the first \u or \U escape sequence in a given string, or
+// NULL if there's none. Escaped backslashes are skipped the same way
+// as convert_universal_chars() does.
+static char *find_universal_char(char *p) {
+    while ((p = strchr(p, '\\'))) {
+        if (p[1] == 'u' || p[1] == 'U')
+            return p;
+        if (p[1] == '\0')
+            return NULL;
+        p += 2;
+    }
+    return NULL;
+}
+
 // Replace \u or \U escape sequences with corresponding UTF-8 bytes.
+// `p` points to the first one; the text before it is left untouched.
 static void convert_universal_chars(char *p) {
     char *q = p;
 
@@ -632,18 +947,54 @@ static void convert_universal_chars(char *p) {
     *q = '\0';
 }
 
+// Registers a new input file and emits a .file directive for the
+// assembler. Each inclusion of a header gets its own file number.
+SourceFile *new_input_file(char *path, char *contents) {
+    static int file_no;
+    file_no++;
+    if (opt_g && !opt_E && !opt_emit_pch)
+        printf(".file %d \"%s\"\n", file_no, path);
+    return new_source_file(path, file_no, contents);
+}
+
 Token *tokenize_file(char *path) {
+    timer_start("tokenize", path);
     char *p = read_file(path);
-    if (!p)
+    if (!p) {
+        timer_stop();
         return NULL;
-    
-    remove_backslash_newline(p);
-    convert_universal_chars(p);
+    }
 
-    // Emit a .file directive for the assembler.
-    static int file_no;
-    if (!opt_E)
-        printf(".file %d \"%s\"\n", ++file_no, path);
+    // Most files contain neither line continuations nor universal
+    // character names and are tokenized straight from the buffer.
+    // Otherwise we rewrite it starting from the first occurrence, so
+    // that only the pages after it are copied.
+    char *q = strstr(p, "\\\n");
+    if (q)
+        remove_backslash_newline(q);
+    q = find_universal_char(p);
+    if (q)
+        convert_universal_chars(q);
+
+    Token *tok = tokenize(new_input_file(path, p));
+    timer_stop();
+    return tok;
+}
+
+// Returns a copy of a token list returned by tokenize_file() as if
+// the file had been read and tokenized again.
+Token *copy_file_tokens(Token *tok) {
+    SourceFile *orig = get_source_file(tok);
+    SourceFile *file = new_input_file(orig->name, orig->contents);
 
-    return tokenize(path, file_no, p);
+    Token head = {};
+    Token *cur = &head;
+    for (; tok; tok = tok->next) {
+        Token *t = arena_alloc(&token_arena, sizeof(Token));
+        mem_count(MEM_TOKEN_COPY, sizeof(Token));
+        *t = *tok;
+        t->file = file->index;
+        cur = cur->next = t;
+    }
+    return head.next;
 }
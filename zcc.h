@@ -2,14 +2,17 @@
 #include <assert.h>
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 typedef struct Type Type;
@@ -17,6 +20,84 @@ typedef struct Hideset Hideset;
 typedef struct Member Member;
 typedef struct Relocation Relocation;
 
+//
+// arena.c
+//
+
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct {
+    char *name;
+    ArenaBlock *blocks;
+    char *ptr;     // Next free byte in the current block
+    char *end;     // End of the current block
+    long used;     // Bytes handed out in total
+    long reserved; // Bytes currently held in blocks
+    long peak;     // High-water mark of `reserved`
+} Arena;
+
+extern Arena token_arena;
+extern Arena ast_arena;
+extern Arena type_arena;
+
+void *arena_alloc(Arena *arena, long size);
+void arena_release(Arena *arena);
+void print_arena_stats(void);
+
+// Categories of objects counted by -fmem-report
+typedef enum {
+    MEM_TOKEN,       // tokens created by the tokenizer
+    MEM_TOKEN_COPY,  // tokens copied by the preprocessor
+    MEM_HIDESET,
+    MEM_MACRO,       // macros and their bodies
+    MEM_NODE,
+    MEM_TYPE,
+    MEM_VAR,
+    MEM_INITIALIZER,
+    NUM_MEM_KINDS,
+} MemKind;
+
+typedef enum {
+    PHASE_TOKENIZE,
+    PHASE_PREPROCESS,
+    PHASE_PARSE,
+    PHASE_CODEGEN,
+    NUM_PHASES,
+} Phase;
+
+extern bool opt_mem_report;
+
+void mem_count(MemKind kind, long size);
+long mem_objects(MemKind kind);
+void mem_set_phase(Phase phase);
+void print_mem_report(void);
+
+//
+// hashmap.c
+//
+
+typedef struct {
+    char *key;
+    int keylen;
+    void *val;
+} HashEntry;
+
+typedef struct {
+    HashEntry *buckets;
+    int capacity;
+    int used;
+} HashMap;
+
+unsigned int fnv_hash(char *s, int len);
+void *hashmap_get(HashMap *map, char *key);
+void *hashmap_get2(HashMap *map, char *key, int keylen);
+void *hashmap_get3(HashMap *map, char *key, int keylen, unsigned int hash);
+void hashmap_put(HashMap *map, char *key, void *val);
+void hashmap_put2(HashMap *map, char *key, int keylen, void *val);
+void hashmap_put3(HashMap *map, char *key, int keylen, unsigned int hash, void *val);
+void hashmap_delete(HashMap *map, char *key);
+void hashmap_delete2(HashMap *map, char *key, int keylen);
+
 //
 // tokenize.c
 //
@@ -31,38 +112,173 @@ typedef enum {
     TK_EOF,      // End-of-file markers
 } TokenKind;
 
+// Keywords, punctuators and preprocessing directive names.
+// The tokenizer stamps one of these on each token whose text is
+// one of them, so that they can be compared as integers. The order
+// must match `reserved_names` in tokenize.c.
+typedef enum {
+    ID_NONE,
+
+    // Keywords
+    KW_RETURN,
+    KW_IF,
+    KW_ELSE,
+    KW_FOR,
+    KW_WHILE,
+    KW_INT,
+    KW_SIZEOF,
+    KW_CHAR,
+    KW_STRUCT,
+    KW_UNION,
+    KW_SHORT,
+    KW_LONG,
+    KW_VOID,
+    KW_TYPEDEF,
+    KW_BOOL,
+    KW_ENUM,
+    KW_STATIC,
+    KW_BREAK,
+    KW_CONTINUE,
+    KW_GOTO,
+    KW_SWITCH,
+    KW_CASE,
+    KW_DEFAULT,
+    KW_EXTERN,
+    KW_ALIGNOF,
+    KW_ALIGNAS,
+    KW_DO,
+    KW_SIGNED,
+    KW_UNSIGNED,
+    KW_CONST,
+    KW_VOLATILE,
+    KW_RESTRICT,
+    KW_FLOAT,
+    KW_DOUBLE,
+
+    // Punctuators
+    P_LPAREN,     // (
+    P_RPAREN,     // )
+    P_LBRACE,     // {
+    P_RBRACE,     // }
+    P_LBRACKET,   // [
+    P_RBRACKET,   // ]
+    P_SEMICOLON,  // ;
+    P_COMMA,      // ,
+    P_DOT,        // .
+    P_ELLIPSIS,   // ...
+    P_ARROW,      // ->
+    P_PLUS,       // +
+    P_MINUS,      // -
+    P_STAR,       // *
+    P_SLASH,      // /
+    P_PERCENT,    // %
+    P_AMP,        // &
+    P_PIPE,       // |
+    P_CARET,      // ^
+    P_TILDE,      // ~
+    P_NOT,        // !
+    P_QUESTION,   // ?
+    P_COLON,      // :
+    P_LT,         // <
+    P_GT,         // >
+    P_ASSIGN,     // =
+    P_HASH,       // #
+    P_HASHHASH,   // ##
+    P_EQ,         // ==
+    P_NE,         // !=
+    P_LE,         // <=
+    P_GE,         // >=
+    P_ADD_ASSIGN, // +=
+    P_SUB_ASSIGN, // -=
+    P_MUL_ASSIGN, // *=
+    P_DIV_ASSIGN, // /=
+    P_MOD_ASSIGN, // %=
+    P_AND_ASSIGN, // &=
+    P_OR_ASSIGN,  // |=
+    P_XOR_ASSIGN, // ^=
+    P_SHL_ASSIGN, // <<=
+    P_SHR_ASSIGN, // >>=
+    P_INC,        // ++
+    P_DEC,        // --
+    P_LOGAND,     // &&
+    P_LOGOR,      // ||
+    P_SHL,        // <<
+    P_SHR,        // >>
+
+    // Preprocessing directive names that are not keywords
+    PP_INCLUDE,
+    PP_DEFINE,
+    PP_UNDEF,
+    PP_IFDEF,
+    PP_IFNDEF,
+    PP_ELIF,
+    PP_ENDIF,
+    PP_ERROR,
+    PP_DEFINED,
+    PP_PRAGMA,
+    PP_ONCE,
+
+    NUM_TOKEN_IDS,
+} TokenId;
+
+// Per-file data shared by all tokens of an input buffer. Tokens
+// refer to their file by index into a table kept by the tokenizer.
+typedef struct {
+    char *name;     // Input filename
+    int file_no;    // File number for .loc directive
+    int index;      // Index in the table, i.e. Token::file
+    char *contents; // Entire input string
+} SourceFile;
+
+// Payload of numeric and string literal tokens. Most tokens are
+// identifiers or punctuators, so this is kept out of Token itself.
+typedef struct {
+    long val;       // If kind is TK_NUM, its value
+    double fval;    // If kind is TK_NUM, its value
+    Type *ty;       // Used if TK_NUM
+    char *contents; // String literal contents including terminating '\0'
+    int cont_len;   // string literal length
+} Literal;
+
 // Token type
+//
+// Tokens are the most numerous objects in the compiler, so this
+// struct is laid out to fit in a single 64-byte cache line.
 typedef struct Token Token;
 struct Token {
-    TokenKind kind;   // Token kind
-    Token *next;      // Next token
-    long val;         // If kind is TK_NUM, its value
-    double fval;      // If kind is TK_NUM, its value
-    Type *ty;         // Used if TK_NUM
-    char *loc;        // Token location
-    int len;          // Token length
-
-    char *contents;   // String literal contents including terminating '\0'
-    char cont_len;    // string literal length
-
-    char *filename;   // Input filename
-    char *input;      // Entire input string
-    int line_no;      // Line number
-    int file_no;      // File number for .loc directive
-    bool at_bol;      // True if this token is at beginning of line
-    bool has_space;   // True if this token follows a space character
-    Hideset *hideset; // For macro expansion
+    Token *next;       // Next token
+    char *loc;         // Token location
+    char *sym;         // Interned name if TK_IDENT or TK_RESERVED
+    Hideset *hideset;  // For macro expansion
+    Literal *lit;      // Literal payload if TK_NUM or TK_STR
+    int len;           // Token length
+    unsigned int hash; // fnv_hash() of the name if `sym` is set
+    int line_no;       // Line number
+    int file;          // Index of the SourceFile
+    TokenKind kind;    // Token kind
+    unsigned char id;  // TokenId of a keyword or punctuator, or ID_NONE
+    bool at_bol;       // True if this token is at beginning of line
+    bool has_space;    // True if this token follows a space character
 };
 
+extern int warning_count;
+
 void error(char *fmt, ...);
 void error_tok(Token *tok, char *fmt, ...);
 void warn_tok(Token *tok, char *fmt, ...);
+char *intern(char *s, int len);
 bool equal(Token *tok, char *op);
 Token *skip(Token *tok, char *op);
 bool consume(Token **rest, Token *tok, char *str);
 void convert_pp_tokens(Token *tok);
-Token *tokenize(char *filename, int file_no, char *p);
+SourceFile *new_source_file(char *name, int file_no, char *contents);
+SourceFile *get_source_file(Token *tok);
+SourceFile **get_source_files(int *len);
+SourceFile *new_input_file(char *path, char *contents);
+void intern_token(Token *tok);
+Token *tokenize(SourceFile *file);
 Token *tokenize_file(char *filename);
+Token *copy_file_tokens(Token *tok);
 
 //
 // preprocess.c
@@ -70,7 +286,11 @@ Token *tokenize_file(char *filename);
 
 void init_macros(void);
 void define_macro(char *name, char *buf);
+void cmdline_define(char *name, char *buf);
+void cmdline_undef(char *name);
 Token *preprocess(Token *tok);
+void write_pch(Token *tok);
+void read_pch(char *path);
 
 //
 // parse.c
@@ -88,6 +308,9 @@ struct Var {
 
     // Local variable
     int offset;
+    int reg;        // register chosen by regalloc.c plus one, or 0
+    bool in_memory; // cannot be kept in a register
+    long uses;      // number of uses weighted by loop nesting
 
     // Global variable
     bool is_static;
@@ -212,6 +435,10 @@ struct Function {
     Node *node;
     Var *locals;
     int stack_size;
+
+    // Numbers of GPRs and XMM registers used for variables
+    int gp_regs;
+    int fp_regs;
 };
 
 typedef struct {
@@ -251,6 +478,7 @@ struct Type {
     bool is_signed;     // true if "signed" keyword is specified
     bool is_incomplete; // incomplete type
     bool is_const;
+    bool is_volatile;
 
     // Pointer-to or array-of type. We intentionally use the same member
     // to represent pointer/array duality in C.
@@ -330,17 +558,63 @@ int size_of(Type *ty);
 Type *copy_type(Type *ty);
 void add_type(Node *node);
 
+//
+// regalloc.c
+//
+
+// Numbers of registers available for variables
+#define NUM_GP_VAR_REGS 5
+#define NUM_FP_VAR_REGS 8
+
+extern bool opt_regalloc;
+
+void alloc_regs(Function *fn);
+
 //
 // codegen.c
 //
 
 void codegen(Program *prog);
 
+//
+// cache.c
+//
+
+extern char *cache_dir;
+
+char *cache_entry(Token *tok);
+bool cache_read(char *path);
+void cache_begin(char *path);
+void cache_end(void);
+
+//
+// timing.c
+//
+
+extern bool opt_time_report;
+extern char *opt_time_trace;
+
+extern long stat_macro_expansions;
+
+void timer_start(char *name, char *detail);
+void timer_stop(void);
+void print_time_report(void);
+void write_time_trace(char *path);
+
+//
+// asm.c
+//
+
+void assemble(char *input, char *output);
+
 //
 // main.c
 //
 
 extern bool opt_E;
 extern bool opt_fpic;
+extern bool opt_g;
+extern bool opt_arena_stats;
+extern bool opt_emit_pch;
 
 extern char **include_paths;